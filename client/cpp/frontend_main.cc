@@ -0,0 +1,118 @@
+// 常驻的搜索前端进程, 代替每次搜索都要 fork/exec 的 CGI 客户端.
+// RPC 连接和解析好的模板在进程启动时创建一次, 之后所有的搜索共用.
+// HTTP 服务器通过 unix socket 和这个进程交互, 每个连接处理一次搜索:
+// a) HTTP 服务器先发送一行 "GET <QUERY_STRING>\n", 或者 "POST <CONTENT_LENGTH>\n"
+//    再跟着 CONTENT_LENGTH 字节的 body, 和 CGI 的环境变量/标准输入一一对应
+// b) 前端进程把生成的 html 页面写回去(先写不依赖搜索结果的部分), 然后关闭连接
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <vector>
+#include <base/base.h>
+#include "search_page.h"
+
+DEFINE_string(server_addr, "127.0.0.1:10000", "请求的搜索服务器的地址");
+DEFINE_string(template_path, "../../front/template/search_page.html", "模板文件的路径");
+DEFINE_string(frontend_sock_path, "/tmp/search_frontend.sock", "监听的 unix socket 路径");
+DEFINE_int32(frontend_thread_num, 8, "处理搜索的线程数, 每个线程同时处理一个连接");
+DEFINE_int32(frontend_read_timeout_ms, 3000, "读取请求的超时时间, 超时后关闭连接");
+
+namespace doc_client {
+
+// 读出请求行, 以及 POST 请求的 body. 多读出来的部分是 body 的开头
+static bool ReadRequest(int fd, std::string* query) {
+  std::string data;
+  char buf[4096];
+  size_t line_end = std::string::npos;
+  while ((line_end = data.find('\n')) == std::string::npos) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0 || data.size() > 64 * 1024) {
+      return false;
+    }
+    data.append(buf, n);
+  }
+  const std::string line = data.substr(0, line_end);
+  const size_t space = line.find(' ');
+  if (space == std::string::npos) {
+    return false;
+  }
+  const std::string method = line.substr(0, space);
+  const std::string arg = line.substr(space + 1);
+  if (method == "GET") {
+    // 和 CGI 客户端一样, 去掉 QUERY_STRING 开头的 1=
+    *query = arg.size() > 2 ? arg.substr(2) : "";
+    return true;
+  }
+  const size_t content_length = strtoul(arg.c_str(), NULL, 10);
+  std::string body = data.substr(line_end + 1);
+  while (body.size() < content_length) {
+    ssize_t n = read(fd, buf, std::min(sizeof(buf), content_length - body.size()));
+    if (n <= 0) {
+      return false;
+    }
+    body.append(buf, n);
+  }
+  body.resize(content_length);
+  *query = body;
+  return true;
+}
+
+void ServeLoop(int listen_fd, SearchPage* page) {
+  while (true) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      PLOG(ERROR) << "accept failed";
+      continue;
+    }
+    // 每个线程一次只处理一个连接, 请求一直发不完时不能让线程永远阻塞在 read 上
+    timeval timeout;
+    timeout.tv_sec = fLI::FLAGS_frontend_read_timeout_ms / 1000;
+    timeout.tv_usec = fLI::FLAGS_frontend_read_timeout_ms % 1000 * 1000;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+      PLOG(WARNING) << "set SO_RCVTIMEO failed";
+    }
+    std::string query;
+    if (ReadRequest(fd, &query)) {
+      // 页面边生成边写回去, HTTP 服务器收到多少就转发多少
+      PageWriter writer(fd);
+      page->Render(query, &writer);
+    } else {
+      LOG(WARNING) << "bad request from http server";
+    }
+    close(fd);
+  }
+}
+
+}  // end doc_client
+
+int main(int argc, char* argv[]) {
+  base::InitApp(argc, argv);
+  doc_client::SearchPage page(fLS::FLAGS_server_addr, fLS::FLAGS_template_path);
+  CHECK(page.Init()) << "load template failed! path=" << fLS::FLAGS_template_path;
+  // HTTP 服务器提前关闭连接时, 写 socket 不能导致进程退出
+  signal(SIGPIPE, SIG_IGN);
+  // 1. 创建 unix socket 并监听, 上一次运行留下的 socket 文件要先删掉
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  PCHECK(listen_fd >= 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  CHECK(fLS::FLAGS_frontend_sock_path.size() < sizeof(addr.sun_path));
+  strcpy(addr.sun_path, fLS::FLAGS_frontend_sock_path.c_str());
+  unlink(addr.sun_path);
+  PCHECK(bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) == 0);
+  PCHECK(listen(listen_fd, 1024) == 0);
+  LOG(INFO) << "frontend start! sock=" << fLS::FLAGS_frontend_sock_path;
+  // 2. 多个线程同时在 listen_fd 上 accept, 每个线程一次处理一个连接
+  std::vector<std::thread> threads;
+  for (int i = 0; i < std::max(fLI::FLAGS_frontend_thread_num, 1); ++i) {
+    threads.emplace_back(doc_client::ServeLoop, listen_fd, &page);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  return 0;
+}
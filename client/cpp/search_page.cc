@@ -0,0 +1,140 @@
+#include "search_page.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <base/base.h>
+#include "../../common/util.hpp"
+
+DEFINE_int32(deadline_ms, 2000, "服务器处理查询的时间上限(毫秒), 要比 RPC 的超时时间短");
+DEFINE_int32(rpc_timeout_ms, 3000, "调用搜索服务器的超时时间(毫秒)");
+
+namespace doc_client {
+
+// 攒够这么多数据才调用一次 write
+static const size_t kPageWriterBufferSize = 16 * 1024;
+
+PageWriter::PageWriter(int fd) : fd_(fd), ok_(true) {
+  buf_.reserve(kPageWriterBufferSize);
+}
+
+PageWriter::~PageWriter() {
+  Flush();
+}
+
+void PageWriter::Emit(char c) {
+  Emit(&c, 1);
+}
+
+void PageWriter::Emit(const std::string& s) {
+  Emit(s.data(), s.size());
+}
+
+void PageWriter::Emit(const char* s) {
+  Emit(s, strlen(s));
+}
+
+void PageWriter::Emit(const char* s, size_t len) {
+  buf_.append(s, len);
+  if (buf_.size() >= kPageWriterBufferSize) {
+    Flush();
+  }
+}
+
+bool PageWriter::Flush() {
+  const char* data = buf_.data();
+  size_t size = buf_.size();
+  while (ok_ && size > 0) {
+    ssize_t n = write(fd_, data, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ok_ = false;
+      break;
+    }
+    data += n;
+    size -= n;
+  }
+  buf_.clear();
+  return ok_;
+}
+
+SearchPage::SearchPage(const std::string& server_addr, const std::string& template_path)
+  : channel_(&client_, server_addr), template_path_(template_path), next_sid_(0) {
+}
+
+bool SearchPage::Init() {
+  // ctemplate 会把解析好的模板缓存在进程中, 之后的 GetTemplate 不会再读文件
+  return ctemplate::Template::GetTemplate(template_path_, ctemplate::DO_NOT_STRIP) != NULL;
+}
+
+bool SearchPage::Render(const std::string& query, PageWriter* writer) {
+  // 1. 不依赖搜索结果的部分先写出去
+  WriteHead(writer);
+  writer->Flush();
+  // 2. 调用服务器进行搜索, 再写结果部分
+  Request req;
+  Response resp;
+  PackageRequest(query, &req);
+  bool ok = Search(req, &resp);
+  ParseResponse(resp, writer);
+  writer->Flush();
+  return ok;
+}
+
+void SearchPage::PackageRequest(const std::string& query, Request* req) {
+  // 同一个进程中的请求用递增的 sid 区分
+  req->set_sid(next_sid_++);
+  req->set_timestamp(common::TimeUtil::TimeStamp());
+  // 超时之前服务器返回已经找到的结果, 不会让整个调用失败
+  req->set_deadline_ms(fLI::FLAGS_deadline_ms);
+  req->set_query(query);
+}
+
+bool SearchPage::Search(const Request& req, Response* resp) {
+  // 此函数需要调用 RPC 框架中的服务器所提供的 Search 函数.
+  // RpcClient 和 RpcChannel 在构造时创建好, 每次调用只需要
+  // 一个 DocServerAPI_Stub 和一个 ctrl 对象
+  using namespace sofa::pbrpc;
+  doc_server_proto::DocServerAPI_Stub stub(&channel_);
+  RpcController ctrl;
+  ctrl.SetTimeout(fLI::FLAGS_rpc_timeout_ms);
+  // 此处在客户端调用的本地函数就相当于调用到远端服务器的函数了
+  stub.Search(&ctrl, &req, resp, NULL);
+  // 是否远程调用成功
+  if (ctrl.Failed()) {
+    LOG(ERROR) << "PRC Search failed! sid=" << req.sid() << " " << ctrl.ErrorText();
+    resp->Clear();
+    return false;
+  }
+  return true;
+}
+
+void SearchPage::WriteHead(PageWriter* writer) {
+  ctemplate::TemplateDictionary dict("SearchPage");
+  dict.ShowSection("page_head");
+  ctemplate::Template* tpl = ctemplate::Template::GetTemplate(template_path_,
+                                                              ctemplate::DO_NOT_STRIP);
+  tpl->Expand(writer, &dict);
+}
+
+void SearchPage::ParseResponse(const Response& resp, PageWriter* writer) {
+  // 此处使用 ctemplate 完成页面的构造.
+  // 目的为了 html 所描述的界面和 cpp 所描述的逻辑拆分开.
+  // 模板展开的结果直接写到 writer 中, 不先拼成一个完整的字符串
+  ctemplate::TemplateDictionary dict("SearchPage");
+  dict.ShowSection("page_body");
+  for (int i = 0; i < resp.item_size(); ++i) {
+    ctemplate::TemplateDictionary* table_dict = dict.AddSectionDictionary("item");
+    table_dict->SetValue("title", resp.item(i).title());
+    table_dict->SetValue("desc", resp.item(i).desc());
+    table_dict->SetValue("jump_url", resp.item(i).jump_url());
+    table_dict->SetValue("show_url", resp.item(i).show_url());
+  }
+  ctemplate::Template* tpl = ctemplate::Template::GetTemplate(template_path_,
+                                                              ctemplate::DO_NOT_STRIP);
+  // 对模板进行替换
+  tpl->Expand(writer, &dict);
+}
+
+}  // end doc_client
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <ctemplate/template.h>
+#include <sofa/pbrpc/pbrpc.h>
+#include "server.pb.h"
+
+namespace doc_client {
+
+typedef doc_server_proto::Request Request;
+typedef doc_server_proto::Response Response;
+
+// 把模板展开的结果写到 fd 中(CGI 程序的标准输出, 或者前端进程和 HTTP 服务器之间的 socket).
+// 攒够一定的大小或者调用 Flush 时才调用 write, 写失败(对端已经关闭)之后的数据直接丢弃
+class PageWriter : public ctemplate::ExpandEmitter {
+public:
+  explicit PageWriter(int fd);
+  virtual ~PageWriter();
+
+  virtual void Emit(char c);
+  virtual void Emit(const std::string& s);
+  virtual void Emit(const char* s);
+  virtual void Emit(const char* s, size_t len);
+  // 把缓存的数据都写出去, 写失败时返回 false
+  bool Flush();
+
+private:
+  int fd_;
+  bool ok_;
+  std::string buf_;
+};
+
+// 生成搜索结果页面: 调用搜索服务器, 把结果填到模板中.
+// RPC 的连接和加载好的模板在对象的整个生命周期中一直保留,
+// 可以被多个线程同时使用. 常驻的前端进程只需要创建一个.
+// 页面是流式输出的: 模板中的 page_head 部分不依赖搜索结果, 在调用搜索服务器之前
+// 就先写出去, 浏览器可以提前开始加载和渲染, 结果部分拿到响应之后再写
+class SearchPage {
+public:
+  SearchPage(const std::string& server_addr, const std::string& template_path);
+
+  // 加载模板文件, 失败时返回 false
+  bool Init();
+  // 对查询词进行搜索, 把 html 页面写到 writer 中. RPC 失败时页面中没有结果
+  bool Render(const std::string& query, PageWriter* writer);
+
+private:
+  void PackageRequest(const std::string& query, Request* req);
+  bool Search(const Request& req, Response* resp);
+  void WriteHead(PageWriter* writer);
+  void ParseResponse(const Response& resp, PageWriter* writer);
+
+  sofa::pbrpc::RpcClient client_;
+  sofa::pbrpc::RpcChannel channel_;
+  std::string template_path_;
+  std::atomic<uint64_t> next_sid_;
+};
+
+}  // end doc_client
@@ -0,0 +1,82 @@
+#pragma once
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+namespace common {
+
+// 有界阻塞队列, 用于连接生产者和消费者线程.
+// a) 队列满时 Push 阻塞, 让上游的速度被下游限制住, 内存不会无限增长
+// b) 队列空时 Pop 阻塞, 直到有新元素或者队列被关闭
+// c) Close 之后不再接受新元素, 已有的元素仍然可以被 Pop 出来
+template <typename T>
+class BlockingQueue {
+public:
+  explicit BlockingQueue(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1), closed_(false) {}
+
+  // 队列已关闭时返回 false
+  bool Push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    queue_.push(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // 队列已关闭并且取空时返回 false
+  bool Pop(T* item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    *item = std::move(queue_.front());
+    queue_.pop();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // 不阻塞的版本. 队列已满或者已关闭时返回 false, item 保持不变
+  bool TryPush(T& item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || queue_.size() >= capacity_) {
+      return false;
+    }
+    queue_.push(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // 不阻塞的版本. 队列为空时返回 false
+  bool TryPop(T* item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+      return false;
+    }
+    *item = std::move(queue_.front());
+    queue_.pop();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  std::queue<T> queue_;
+  size_t capacity_;
+  bool closed_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+};
+
+}  // end common
@@ -0,0 +1,128 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+namespace common {
+
+// 对数分桶的直方图, 用于统计耗时等分布比较宽的数值.
+// 每个 2 的幂区间再平均分成 2^kSubBits 个桶, 分位数的相对误差不超过 1/2^kSubBits.
+// 只允许一个线程写(见 HistogramSet), 但是可以被其他线程同时读
+class Histogram {
+public:
+  static const int kSubBits = 3;
+  static const int kBucketNum = (64 - kSubBits + 1) << kSubBits;
+
+  Histogram() : sum_(0) {
+    for (int i = 0; i < kBucketNum; ++i) {
+      counts_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // 只有一个线程写, 不需要原子的加法, 读写分开即可
+  void Add(uint64_t value) {
+    std::atomic<uint64_t>& count = counts_[BucketOf(value)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  // 把计数累加到 counts(kBucketNum 个元素) 和 sum 中
+  void MergeTo(std::vector<uint64_t>* counts, uint64_t* sum) const {
+    counts->resize(kBucketNum);
+    for (int i = 0; i < kBucketNum; ++i) {
+      (*counts)[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+    *sum += sum_.load(std::memory_order_relaxed);
+  }
+
+  static int BucketOf(uint64_t value) {
+    if (value < (1u << kSubBits)) {
+      return value;
+    }
+    // 最高位是第 high 位, 紧跟着的 kSubBits 位决定区间内的桶
+    const int high = 63 - __builtin_clzll(value);
+    const int shift = high - kSubBits;
+    return ((shift + 1) << kSubBits) + ((value >> shift) & ((1u << kSubBits) - 1));
+  }
+
+  // 桶内最大的数值
+  static uint64_t BucketUpper(int bucket) {
+    if (bucket < (1 << kSubBits)) {
+      return bucket;
+    }
+    const int shift = (bucket >> kSubBits) - 1;
+    const uint64_t base = (uint64_t(1) << kSubBits) | (bucket & ((1 << kSubBits) - 1));
+    return ((base + 1) << shift) - 1;
+  }
+
+  // percentile 取值 [0, 1], 返回对应的桶的上界, 没有数据时返回 0
+  static uint64_t Percentile(const std::vector<uint64_t>& counts, double percentile) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      total += counts[i];
+    }
+    if (total == 0) {
+      return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(percentile * total + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        return BucketUpper(i);
+      }
+    }
+    return BucketUpper(counts.size() - 1);
+  }
+
+private:
+  std::atomic<uint64_t> counts_[kBucketNum];
+  std::atomic<uint64_t> sum_;
+};
+
+// 一组直方图(按下标区分), 每个线程各有一份.
+// a) 写的时候只写本线程的那一份, 不加锁, 也没有缓存行的争用
+// b) 读的时候加锁遍历所有线程的那一份, 合并起来
+// c) 线程第一次写的时候分配并登记, 之后一直保留, 线程退出之后的数据也不会丢.
+//    HistogramSet 一般是全局对象, 需要比使用它的线程活得更久
+class HistogramSet {
+public:
+  explicit HistogramSet(size_t size) : size_(size) {}
+
+  void Add(size_t index, uint64_t value) {
+    LocalHistograms()[index].Add(value);
+  }
+
+  // 合并所有线程中下标为 index 的直方图
+  void Merge(size_t index, std::vector<uint64_t>* counts, uint64_t* sum) const {
+    counts->assign(Histogram::kBucketNum, 0);
+    *sum = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < threads_.size(); ++i) {
+      threads_[i][index].MergeTo(counts, sum);
+    }
+  }
+
+private:
+  Histogram* LocalHistograms() {
+    thread_local std::unordered_map<const HistogramSet*, Histogram*> locals;
+    Histogram*& local = locals[this];
+    if (local == NULL) {
+      std::unique_ptr<Histogram[]> histograms(new Histogram[size_]);
+      local = histograms.get();
+      std::lock_guard<std::mutex> lock(mutex_);
+      threads_.push_back(std::move(histograms));
+    }
+    return local;
+  }
+
+  size_t size_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Histogram[]> > threads_;
+};
+
+}  // end common
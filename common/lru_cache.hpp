@@ -0,0 +1,107 @@
+#pragma once
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+namespace common {
+
+// 按照 key 的 hash 分成若干个分片的 LRU 缓存, 可以被多个线程同时访问.
+// a) 每个分片有自己的锁, 不同分片上的操作互不影响, 减少锁竞争
+// b) 容量按照调用方给出的 charge(一般是字节数) 计算, 超过之后淘汰最久没用过的
+// c) value 在锁内拷贝, 比较大的对象建议用 shared_ptr 包一层
+template <typename K, typename V, typename Hash = std::hash<K> >
+class ShardedLruCache {
+public:
+  ShardedLruCache(size_t capacity, size_t shard_num)
+    : shard_num_(shard_num > 0 ? shard_num : 1),
+      shards_(new Shard[shard_num_]), hits_(0), misses_(0) {
+    for (size_t i = 0; i < shard_num_; ++i) {
+      shards_[i].capacity = capacity / shard_num_;
+    }
+  }
+
+  bool Get(const K& key, V* value) {
+    Shard& shard = GetShard(key);
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        // 移到链表头部, 表示最近使用过
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        *value = it->second->value;
+        ++hits_;
+        return true;
+      }
+    }
+    ++misses_;
+    return false;
+  }
+
+  void Put(const K& key, const V& value, size_t charge) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      shard.usage -= it->second->charge;
+      shard.lru.erase(it->second);
+      shard.index.erase(it);
+    }
+    if (charge > shard.capacity) {
+      return;
+    }
+    while (shard.usage + charge > shard.capacity) {
+      const Entry& last = shard.lru.back();
+      shard.usage -= last.charge;
+      shard.index.erase(last.key);
+      shard.lru.pop_back();
+    }
+    shard.lru.push_front(Entry{key, value, charge});
+    shard.index[key] = shard.lru.begin();
+    shard.usage += charge;
+  }
+
+  void Clear() {
+    for (size_t i = 0; i < shard_num_; ++i) {
+      std::lock_guard<std::mutex> lock(shards_[i].mutex);
+      shards_[i].lru.clear();
+      shards_[i].index.clear();
+      shards_[i].usage = 0;
+    }
+  }
+
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+
+private:
+  struct Entry {
+    K key;
+    V value;
+    size_t charge;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    // 链表头部是最近使用过的, 尾部是最久没有使用过的
+    std::list<Entry> lru;
+    std::unordered_map<K, typename std::list<Entry>::iterator, Hash> index;
+    size_t usage;
+    size_t capacity;
+
+    Shard() : usage(0), capacity(0) {}
+  };
+
+  Shard& GetShard(const K& key) {
+    return shards_[Hash()(key) % shard_num_];
+  }
+
+  size_t shard_num_;
+  std::unique_ptr<Shard[]> shards_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+};
+
+}  // end common
@@ -0,0 +1,87 @@
+#pragma once
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+namespace common {
+
+// 无锁的有界环形队列, 支持多个生产者和多个消费者同时访问.
+// a) 每个槽位带一个序号, 生产者和消费者用 CAS 抢占位置, 不加锁
+// b) 队列满或者空的时候立即返回 false, 不会阻塞调用的线程
+// c) 容量向上取整到 2 的幂
+template <typename T>
+class RingBuffer {
+public:
+  explicit RingBuffer(size_t capacity) : enqueue_pos_(0), dequeue_pos_(0) {
+    size_t size = 2;
+    while (size < capacity) {
+      size *= 2;
+    }
+    mask_ = size - 1;
+    cells_.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // 队列满时返回 false, item 保持不变
+  bool TryPush(T& item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t seq = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        // 槽位空闲, 抢到这个位置之后再写入数据
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.data = std::move(item);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // 队列空时返回 false
+  bool TryPop(T* item) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      const size_t seq = cell.sequence.load(std::memory_order_acquire);
+      const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          *item = std::move(cell.data);
+          // 标记成下一轮可以写入
+          cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  // 生产者和消费者的位置之间隔开一个缓存行, 避免互相影响.
+  // C++11 的 new 不保证按照 alignas 对齐, 所以用填充的方式
+  char pad1_[64];
+  std::atomic<size_t> enqueue_pos_;
+  char pad2_[64];
+  std::atomic<size_t> dequeue_pos_;
+};
+
+}  // end common
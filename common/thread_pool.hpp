@@ -0,0 +1,147 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <condition_variable>
+
+namespace common {
+
+// 带任务窃取的有界线程池.
+// a) 每个线程有自己的任务队列, 外部提交的任务轮流放到各个队列中,
+//    线程中提交的任务放到自己的队列中, 减少多个线程争用同一把锁
+// b) 线程从自己队列的头部取任务(先进先出, 排队时间可控), 自己的队列空了
+//    就从其他线程队列的尾部偷任务, 一个线程上的慢任务不会让其他任务一直等着
+// c) 所有队列中等待的任务总数有上限, 超过之后 TrySubmit 直接返回 false,
+//    由调用方决定怎么处理(比如返回错误码), 不会阻塞调用方
+class WorkStealingPool {
+public:
+  typedef std::function<void()> Task;
+
+  WorkStealingPool(size_t thread_num, size_t capacity)
+    : thread_num_(thread_num > 0 ? thread_num : 1),
+      capacity_(capacity > 0 ? capacity : 1),
+      queues_(new Queue[thread_num_]), queued_(0), next_(0), stop_(false) {
+    for (size_t i = 0; i < thread_num_; ++i) {
+      threads_.emplace_back(&WorkStealingPool::Run, this, i);
+    }
+  }
+
+  // 等待已经提交的任务都执行完之后再退出
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_ = true;
+    }
+    wakeup_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // 等待的任务数已经达到上限时返回 false, task 不会被执行
+  bool TrySubmit(Task task) {
+    if (queued_.fetch_add(1) >= capacity_) {
+      --queued_;
+      return false;
+    }
+    const int self = CurrentIndex();
+    const size_t index = self >= 0 ? self : next_.fetch_add(1) % thread_num_;
+    {
+      std::lock_guard<std::mutex> lock(queues_[index].mutex);
+      queues_[index].tasks.push_back(std::move(task));
+    }
+    // 先拿一下锁再通知, 避免线程检查完 queued_ 准备睡眠时错过这次通知
+    { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+    wakeup_.notify_one();
+    return true;
+  }
+
+  // 在队列中等待执行的任务数
+  size_t queued() const { return queued_; }
+  size_t thread_num() const { return thread_num_; }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // 当前线程在本线程池中的下标, 不是本线程池的线程时返回 -1
+  int CurrentIndex() const {
+    const Owner& owner = LocalOwner();
+    return owner.pool == this ? owner.index : -1;
+  }
+
+  struct Owner {
+    const WorkStealingPool* pool;
+    int index;
+  };
+  static Owner& LocalOwner() {
+    thread_local Owner owner = {NULL, -1};
+    return owner;
+  }
+
+  bool PopLocal(size_t index, Task* task) {
+    Queue& queue = queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    *task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    --queued_;
+    return true;
+  }
+
+  bool Steal(size_t index, Task* task) {
+    for (size_t i = 1; i < thread_num_; ++i) {
+      Queue& queue = queues_[(index + i) % thread_num_];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (!queue.tasks.empty()) {
+        *task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        --queued_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Run(size_t index) {
+    LocalOwner().pool = this;
+    LocalOwner().index = index;
+    Task task;
+    while (true) {
+      if (PopLocal(index, &task) || Steal(index, &task)) {
+        task();
+        task = nullptr;
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      if (queued_ == 0 && stop_) {
+        break;
+      }
+      // queued_ 先于任务放入队列增加, 醒来之后可能还取不到, 重新检查一遍即可
+      wakeup_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0) {
+        break;
+      }
+    }
+  }
+
+  size_t thread_num_;
+  size_t capacity_;
+  std::unique_ptr<Queue[]> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> queued_;
+  std::atomic<size_t> next_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wakeup_;
+  bool stop_;
+};
+
+}  // end common
@@ -4,7 +4,9 @@
 #include <vector>
 #include <unordered_set>
 #include <boost/algorithm/string.hpp>
+#include <boost/utility/string_ref.hpp>
 #include <sys/time.h>
+#include <time.h>
 
 namespace common {
 
@@ -14,10 +16,10 @@ public:
     boost::split(*output, input, boost::is_any_of(split_char), boost::token_compress_off);
   }
 
-  static int32_t FindSentenceBeg(const std::string& content, int32_t first_pos) {
+  static int32_t FindSentenceBeg(boost::string_ref content, int32_t first_pos) {
     for(auto i = first_pos; i >= 0; --i) {
       if (content[i] == ';' || content[i] == ',' || content[i] == '?' || content[i] == '!' || (content[i] == '.' 
-          && content[i + 1] == ' ')) {
+          && i + 1 < (int32_t)content.size() && content[i + 1] == ' ')) {
         return i + 1;
       }
     }
@@ -99,6 +101,12 @@ public:
     ::gettimeofday(&tv, NULL);
     return tv.tv_sec * 1000 * 1000 + tv.tv_usec;
   }
+  //获取单调时钟的纳秒数, 只能用于计算耗时, 不受系统时间调整的影响
+  static int64_t MonotonicNS() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+  }
 };
 
 } // end common
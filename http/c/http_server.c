@@ -1,70 +1,386 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <sys/sendfile.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/uio.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <sys/un.h>
+#include <time.h>
 
 typedef struct sockaddr sockaddr;
 typedef struct sockaddr_in sockaddr_in;
 #define SIZE (1024 * 10)
+//请求行和 header 的最大长度，POST 请求 body 的最大长度，超过之后认为是非法请求
+#define MAX_HEADER_SIZE (1024 * 64)
+#define MAX_BODY_SIZE (1024 * 1024)
+//每次 epoll_wait 最多取出的事件数
+#define MAX_EVENTS 256
+//chunked 编码中块长度那一行的最大长度（十六进制的长度加上 \r\n）
+#define CHUNK_HEADER_SIZE 10
+//不能 splice 时（前端进程的 unix socket）每次从上游读出的最大字节数；CGI 子进程标准输出管道的容量
+#define RELAY_BUFFER_SIZE (1024 * 64)
+#define CGI_PIPE_SIZE (1024 * 1024)
+//静态文件缓存：hash 表的桶数，每个事件循环最多缓存的文件数，
+//不超过 STATIC_MEM_FILE_SIZE 的文件把内容读到内存中，所有文件内容加起来不超过 STATIC_MEM_TOTAL_SIZE
+#define STATIC_CACHE_BUCKETS 1024
+#define STATIC_CACHE_MAX_FILES 1024
+#define STATIC_MEM_FILE_SIZE (1024 * 64)
+#define STATIC_MEM_TOTAL_SIZE (1024 * 1024 * 32)
+//服务器主动关闭连接时，先关闭写端，最多再等这么久让客户端把还在路上的请求发完
+#define LINGER_TIMEOUT_MS 2000
 
+//常驻的搜索前端进程监听的 unix socket 路径（见 client/cpp/frontend_main.cc）
+//为 NULL 时动态页面还是通过 fork/exec CGI 程序生成
+const char* g_frontend_sock_path = NULL;
+//长连接上多久没有任何读写就关闭（-t，单位秒），一个连接上最多处理多少个请求（-n）
+int g_idle_timeout_ms = 15 * 1000;
+int g_max_keepalive_requests = 100;
+//工作线程数（-w，0 表示和 CPU 核数相同），等待工作线程接收的新连接数的上限（-q）
+int g_worker_num = 0;
+int g_conn_queue_size = 1024;
+
+//静态文件的缓存时间，按 url 的前缀配置（-c /BoostSearchEngine/images/=86400），匹配最长的前缀。
+//没有配置的目录发送 Cache-Control: no-cache，浏览器每次都带上 ETag/Last-Modified 来验证，
+//文件没有变化时只返回 304
+#define MAX_CACHE_CONTROL_RULES 32
+typedef struct CacheControlRule{
+  const char *url_prefix;
+  int max_age;
+}CacheControlRule;
+CacheControlRule g_cache_control_rules[MAX_CACHE_CONTROL_RULES];
+int g_cache_control_rule_num = 0;
+
+//请求中的字符串都直接指向连接的读缓冲区（解析时把分隔符替换成了 \0），不做拷贝，
+//只在解析完之后立刻使用
 typedef struct HttpRequest{
-  char first_line[SIZE];
+  char *first_line;
   char *method;
   char *url;
   char *url_path;
   char *query_string;
+  char *version;
   int content_length;
+  //条件请求的 header，没有时为 NULL
+  char *if_none_match;
+  char *if_modified_since;
+  char *body;
 }HttpRequest;
 
-//这个函数需要考虑不同换行符的问题(浏览器发送的换行符不一定是\n,还可能是 \r , \r\n等)
-//处理逻辑：
-//1.循环从 socket 中读取字符，一次读一个
-//2.对读取到的字符进行判定
-//3.如果当前字符是 \r
-// a）尝试从缓冲区中读取下一个字符，判定下一个字符是 \n，就把这种情况处理为\n
-// b）如果下一个字符是其他字符，就把 \r修改成 \n
-//4.如果当前字符是\n,就退出循环，函数结束
-//5.如果当前字符是其他字符，就把这个字符放到缓冲区中
-int ReadLine(int sock, char buf[], ssize_t max_size){
-  //按行从 socket 中读取数据 
-  char c = '\0';
-  ssize_t i = 0; //作为填充缓冲区的下标
-  while(i < max_size){
-    ssize_t read_size = recv(sock, &c, 1, 0); 
-    if(read_size <= 0){
-      //此时认为读取数据失败，即使read_size= 0。由于此时我们预期是至少能读到换行标记的，如果还没读到换行标记就结束了
-      //说明很可能收到的报文就是非法的
-      printf("read_size <= 0\n");
+typedef enum ParseState{
+  kParseFirstLine,
+  kParseHeader,
+  kParseBody,
+}ParseState;
+
+//增量的请求解析器。每次收到数据之后只扫描新到的部分，不会从头再解析一次。
+//记录的都是相对于请求开头（读缓冲区的 pos）的偏移，缓冲区扩容或者挪动数据之后依然有效
+typedef struct HttpParser{
+  ParseState state;
+  size_t scan;        //下一个还没有扫描过的字节
+  size_t line;        //当前行的开头
+  size_t first_line;  //首行的开头
+  int content_length;
+  //Connection 这个 header 的取值：0 表示没有，1 表示 keep-alive，-1 表示 close
+  int connection;
+  //If-None-Match 和 If-Modified-Since 的值的偏移，0 表示没有这个 header
+  size_t if_none_match;
+  size_t if_modified_since;
+}HttpParser;
+
+//可以增长的缓冲区，[pos, size) 是还没有处理的数据
+typedef struct Buffer{
+  char *data;
+  size_t size;
+  size_t cap;
+  size_t pos;
+}Buffer;
+
+//保证缓冲区末尾至少还有 n 个字节的空闲空间
+int BufferReserve(Buffer* buf, size_t n){
+  if(buf->pos > 0 && buf->pos == buf->size){
+    buf->pos = buf->size = 0;
+  }
+  if(buf->cap - buf->size >= n){
+    return 0;
+  }
+  //先把已经处理过的数据挪走，空间还不够再扩容
+  if(buf->pos > 0){
+    memmove(buf->data, buf->data + buf->pos, buf->size - buf->pos);
+    buf->size -= buf->pos;
+    buf->pos = 0;
+    if(buf->cap - buf->size >= n){
+      return 0;
+    }
+  }
+  size_t cap = buf->cap > 0 ? buf->cap : 1024;
+  while(cap - buf->size < n){
+    cap *= 2;
+  }
+  char* data = (char*)realloc(buf->data, cap);
+  if(data == NULL){
+    return -1;
+  }
+  buf->data = data;
+  buf->cap = cap;
+  return 0;
+}
+
+int BufferAppend(Buffer* buf, const char* data, size_t size){
+  if(BufferReserve(buf, size) < 0){
+    return -1;
+  }
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+  return 0;
+}
+
+int BufferAppendStr(Buffer* buf, const char* str){
+  return BufferAppend(buf, str, strlen(str));
+}
+
+void BufferFree(Buffer* buf){
+  free(buf->data);
+  memset(buf, 0, sizeof(*buf));
+}
+
+//无锁的有界队列，支持多个生产者和多个消费者同时访问（和 common/ring_buffer.hpp 的算法相同）。
+//每个槽位带一个序号，生产者和消费者用 CAS 抢占位置，队列满或者空的时候立即返回 -1
+typedef struct ConnQueueCell{
+  atomic_size_t sequence;
+  int fd;
+}ConnQueueCell;
+
+typedef struct ConnQueue{
+  ConnQueueCell* cells;
+  size_t mask;
+  //生产者和消费者的位置之间隔开一个缓存行，避免互相影响
+  char pad1[64];
+  atomic_size_t enqueue_pos;
+  char pad2[64];
+  atomic_size_t dequeue_pos;
+  char pad3[64];
+}ConnQueue;
+
+//容量向上取整到 2 的幂
+int ConnQueueInit(ConnQueue* queue, size_t capacity){
+  size_t size = 2;
+  while(size < capacity){
+    size *= 2;
+  }
+  queue->cells = (ConnQueueCell*)calloc(size, sizeof(ConnQueueCell));
+  if(queue->cells == NULL){
+    return -1;
+  }
+  queue->mask = size - 1;
+  size_t i = 0;
+  for(; i < size; ++i){
+    atomic_init(&queue->cells[i].sequence, i);
+  }
+  atomic_init(&queue->enqueue_pos, 0);
+  atomic_init(&queue->dequeue_pos, 0);
+  return 0;
+}
+
+int ConnQueuePush(ConnQueue* queue, int fd){
+  size_t pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
+  while(1){
+    ConnQueueCell* cell = &queue->cells[pos & queue->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if(diff == 0){
+      //槽位空闲，抢到这个位置之后再写入数据
+      if(atomic_compare_exchange_weak_explicit(&queue->enqueue_pos, &pos, pos + 1,
+                                               memory_order_relaxed, memory_order_relaxed)){
+        cell->fd = fd;
+        atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+        return 0;
+      }
+    }else if(diff < 0){
       return -1;
+    }else{
+      pos = atomic_load_explicit(&queue->enqueue_pos, memory_order_relaxed);
     }
-    if(c == '\r'){
-      //最后这个参数的意思是，预览下一个字符而不从缓冲区中删除这个字符
-      //即下一次调用recv依然读取到的是这个字符
-      recv(sock, &c, 1, MSG_PEEK);
-      if(c == '\n'){
-        //当前的行分隔符是一个 \r\n
-        //接下来就把下一个 \n 字符从缓冲区中删掉即可
-        recv(sock, &c, 1, 0);
-      }else{
-        // b）如果下一个字符是其他字符，就把 \r修改成 \n
-        c = '\n';
+  }
+}
+
+int ConnQueuePop(ConnQueue* queue, int* fd){
+  size_t pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
+  while(1){
+    ConnQueueCell* cell = &queue->cells[pos & queue->mask];
+    size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if(diff == 0){
+      if(atomic_compare_exchange_weak_explicit(&queue->dequeue_pos, &pos, pos + 1,
+                                               memory_order_relaxed, memory_order_relaxed)){
+        *fd = cell->fd;
+        //标记成下一轮可以写入
+        atomic_store_explicit(&cell->sequence, pos + queue->mask + 1, memory_order_release);
+        return 0;
       }
+    }else if(diff < 0){
+      return -1;
+    }else{
+      pos = atomic_load_explicit(&queue->dequeue_pos, memory_order_relaxed);
     }
-    buf[i++] = c;
-    if(c == '\n'){
-      break;
+  }
+}
+
+//accept 线程把新连接放进 g_conn_queue，再给 g_conn_event_fd 加一，
+//所有工作线程的 epoll 中都注册了 g_conn_event_fd，每次只唤醒其中一个来取连接
+ConnQueue g_conn_queue;
+int g_conn_event_fd = -1;
+
+//epoll 中注册的每个 fd 都对应一个 Handle，用来区分事件是哪里来的
+typedef enum HandleType{
+  kHandleConnQueue,
+  kHandleInotify,
+  kHandleClient,
+  kHandleUpstream,
+}HandleType;
+
+//缓存的静态文件，以 url_path 为 key。响应头在加载时就拼好（长连接和短连接各一份），
+//小文件的内容也读到内存中，命中之后只需要一次 writev；大文件保留打开的 fd，用 sendfile 发送。
+//文件所在目录的 inotify 事件会让这个目录下的缓存失效，正在发送的连接还持有引用，
+//引用计数减到 0 时才真正释放
+typedef struct StaticFile{
+  char *url_path;
+  //header[0] 是 200 的响应头，header[1] 是 304 的；header[x][1] 用于长连接，header[x][0] 用于短连接
+  char *header[2][2];
+  size_t header_len[2][2];
+  //缓存验证用的 ETag（由 inode、纳秒精度的修改时间和文件大小生成）和修改时间。
+  //同一秒内改了两次并且大小不变，或者整个文件被替换成同样大小、同样时间戳的新文件，ETag 也不同
+  char etag[80];
+  time_t mtime;
+  int fd;
+  char *data;
+  size_t size;
+  //文件所在目录的 inotify watch
+  int wd;
+  int ref;
+  //已经从缓存中移除（或者没有放进缓存）
+  int stale;
+  struct StaticFile* next;
+}StaticFile;
+
+struct Connection;
+typedef struct Handle{
+  HandleType type;
+  struct Connection* conn;
+}Handle;
+
+//每个工作线程一个事件循环，处理从 g_conn_queue 中取出的连接
+typedef struct EventLoop{
+  int epoll_fd;
+  Handle queue_handle;
+  //本轮事件中关闭的连接，事件都处理完之后再释放，避免后面的事件访问已经释放的连接
+  struct Connection* closed;
+  //所有的连接按照最后一次读写的时间排成一个链表，最久没有读写的在前面，
+  //检查空闲超时只需要看链表的开头
+  struct Connection* active_head;
+  struct Connection* active_tail;
+  //正在延迟关闭的连接，超时时间都一样，按照开始延迟关闭的时间排列
+  struct Connection* linger_head;
+  struct Connection* linger_tail;
+  //静态文件缓存只在这个事件循环的线程中访问，不需要加锁
+  StaticFile* static_cache[STATIC_CACHE_BUCKETS];
+  int static_file_num;
+  size_t static_mem_size;
+  int inotify_fd;
+  Handle inotify_handle;
+}EventLoop;
+
+//一个客户端连接的状态。所有的 socket 都是非阻塞的，读写不完时记下进度，
+//等下一次事件到来时继续
+typedef struct Connection{
+  int fd;
+  EventLoop* loop;
+  Handle client_handle;
+  Handle upstream_handle;
+  //请求已经读完，正在发送响应
+  int responding;
+  //响应发完之后是否保持连接，连接上已经处理的请求数
+  int keep_alive;
+  int request_num;
+  //动态页面的 body 长度事先不知道，长连接上使用 chunked 编码
+  int chunked;
+  //客户端已经关闭了写端；读缓冲区中积压的请求太多，暂时不再读
+  int eof;
+  int read_blocked;
+  //响应已经发完并且关闭了写端，只是读出并丢弃客户端继续发来的数据，等客户端关闭
+  int lingering;
+  int closed;
+  struct Connection* next_closed;
+  int64_t last_active_ms;
+  struct Connection* active_prev;
+  struct Connection* active_next;
+  //从客户端读到的数据，以及还没有发出去的响应数据
+  Buffer in;
+  Buffer out;
+  HttpParser parser;
+  HttpRequest req;
+  //静态页面：正在发送的文件，已经发送的字节数（包括响应头），是否只需要返回 304
+  StaticFile* static_file;
+  size_t static_sent;
+  int not_modified;
+  //动态页面：和前端进程的连接（up_rfd == up_wfd），或者和 CGI 子进程之间的两个管道，
+  //up_out 是还没有发给它们的请求数据
+  int up_rfd;
+  int up_wfd;
+  Buffer up_out;
+  //CGI 的输出管道中还要 splice 到 socket 的字节数
+  size_t splice_remain;
+}Connection;
+
+//从读缓冲区中当前请求的 parser->line 位置开始找出一行，把行分隔符原地替换成 \0，
+//*line_ptr 指向这一行的开头，parser->line 移到下一行的开头
+//这个函数需要考虑不同换行符的问题(浏览器发送的换行符不一定是\n,还可能是 \r , \r\n等)
+//处理逻辑：
+//1.如果当前字符是 \r
+// a）下一个字符是 \n，就把这种情况处理为\n
+// b）如果下一个字符是其他字符，就把 \r当做 \n
+// c）还没有收到下一个字符，说明数据不完整
+//2.如果当前字符是\n,这一行就结束了
+//3.如果当前字符是其他字符，继续向后找
+//返回 1 表示找到了完整的一行，0 表示数据还不完整
+int ReadLine(Buffer* in, HttpParser* parser, char** line_ptr){
+  char* begin = in->data + in->pos;
+  size_t size = in->size - in->pos;
+  size_t p = parser->scan;
+  for(; p < size; ++p){
+    if(begin[p] != '\r' && begin[p] != '\n'){
+      continue;
+    }
+    if(begin[p] == '\r'){
+      if(p + 1 >= size){
+        break;
+      }
+      if(begin[p + 1] == '\n'){
+        //当前的行分隔符是一个 \r\n，跳过后面的 \n
+        begin[p++] = '\0';
+      }
     }
+    begin[p] = '\0';
+    *line_ptr = begin + parser->line;
+    parser->line = parser->scan = p + 1;
+    return 1;
   }
-  buf[i] = '\0'; 
+  parser->scan = p;
   return 0;
 }
 
@@ -73,7 +389,7 @@ ssize_t Split(char first_line[], const char* split_char, char *output[]){
   int output_index = 0;
   char *tmp = NULL;//此处的 temp 必须是栈上的变量(因为每一个线程都有自己独有的线程栈，不会出现线程不安全的问题)
   char *p = strtok_r(first_line, split_char, &tmp);
-  while(p != NULL){
+  while(p != NULL && output_index < 100){
     output[output_index++] = p;
     //后续循环调用的时候，第一个参数要填NULL
     //此时函数就会根据上次切分的结果，继续向下切分
@@ -82,7 +398,7 @@ ssize_t Split(char first_line[], const char* split_char, char *output[]){
   return output_index;
 }
 
-int ParseFirstLine(char first_line[], char **method_ptr, char **url_ptr){
+int ParseFirstLine(char first_line[], char **method_ptr, char **url_ptr, char **version_ptr){
   char *tokens[100] = {NULL};
   //Split 切分完毕后，就会破坏掉原有的字符串，把其中的分隔符替换成 \0
   ssize_t n = Split(first_line, " ", tokens);
@@ -91,8 +407,13 @@ int ParseFirstLine(char first_line[], char **method_ptr, char **url_ptr){
     return -1;
   }
   //验证 token[2] 是否包含 HTTP 这样的关键字（字符串匹配）
+  if(strncasecmp(tokens[2], "HTTP/", 5) != 0){
+    printf("first_line version error! version = %s\n", tokens[2]);
+    return -1;
+  }
   *method_ptr = tokens[0];
   *url_ptr = tokens[1];
+  *version_ptr = tokens[2];
   return 0;
 }
 
@@ -101,7 +422,7 @@ int ParseQueryString(char url[], char **url_path_ptr, char **query_string_ptr){
   char *p = url;
   for(; *p != '\0'; ++p){
     if(*p == '?'){
-      //找到了？，说明此时url 中带有 query_string 
+      //找到了？，说明此时url 中带有 query_string
       //先把 ？这个字符替换成 \0
       *p = '\0';
       *query_string_ptr = p + 1;
@@ -113,32 +434,116 @@ int ParseQueryString(char url[], char **url_path_ptr, char **query_string_ptr){
   return 0;
 }
 
-int HandlerHeader(int new_sock, int *content_length_ptr){
-  char buf[SIZE] = {0};
- 
-  while(1){
-    if(ReadLine(new_sock, buf, sizeof(buf)) < 0){
-      printf("ReadLine faild!\n");
+//跳过 header 名字和后面的空格，返回值相对于请求开头的偏移
+size_t HeaderValueOffset(const char* line, size_t line_offset, size_t name_len){
+  size_t i = name_len;
+  while(line[i] == ' ' || line[i] == '\t'){
+    ++i;
+  }
+  return line_offset + i;
+}
+
+//解析一行 header（简略考虑，只保留content_length，connection 和条件请求的 header，
+//其他的header 内容直接丢弃）。line_offset 是这一行相对于请求开头的偏移
+void HandlerHeader(HttpParser* parser, const char* line, size_t line_offset){
+  const char *content_len_ptr = "Content-Length:";
+  const char *connection_ptr = "Connection:";
+  const char *if_none_match_ptr = "If-None-Match:";
+  const char *if_modified_since_ptr = "If-Modified-Since:";
+  if(strncasecmp(line, if_none_match_ptr, strlen(if_none_match_ptr)) == 0){
+    parser->if_none_match = HeaderValueOffset(line, line_offset, strlen(if_none_match_ptr));
+  }else if(strncasecmp(line, if_modified_since_ptr, strlen(if_modified_since_ptr)) == 0){
+    parser->if_modified_since = HeaderValueOffset(line, line_offset, strlen(if_modified_since_ptr));
+  }else if(strncasecmp(line, content_len_ptr, strlen(content_len_ptr)) == 0){
+    parser->content_length = atoi(line + strlen(content_len_ptr));
+  }else if(strncasecmp(line, connection_ptr, strlen(connection_ptr)) == 0){
+    const char* value = line + strlen(connection_ptr);
+    if(strcasestr(value, "close") != NULL){
+      parser->connection = -1;
+    }else if(strcasestr(value, "keep-alive") != NULL){
+      parser->connection = 1;
+    }
+  }
+}
+
+//解析连接中新收到的数据。请求不完整时返回 0，等收到更多数据之后从上次的位置继续；
+//请求完整时返回 1，并把读缓冲区的 pos 移到下一个请求的开头（客户端可能一次发送了多个请求）；
+//请求非法时返回 -1
+int ParseRequest(Connection* conn){
+  HttpParser* parser = &conn->parser;
+  HttpRequest* req = &conn->req;
+  char* line = NULL;
+  while(parser->state != kParseBody){
+    int ret = ReadLine(&conn->in, parser, &line);
+    //请求行和 header 太长，认为是非法请求
+    if(parser->scan > MAX_HEADER_SIZE){
       return -1;
     }
-    if(strcmp(buf, "\n") == 0){
-      //说明读到了空行，此时 header 部分就结束了
+    if(ret == 0){
       return 0;
     }
-    const char *content_len_ptr = "Content-Length: ";
-    if(strncmp(buf, content_len_ptr, strlen(content_len_ptr)) == 0){
-      *content_length_ptr = atoi(buf + strlen(content_len_ptr));
-      //此处代码不能直接 return，因为本函数有两重含义
-      //第一重：找到 content_length 的值
-      //第二重：把接收缓冲区中收到的数据都读出来，也就是从缓冲区中删除掉，避免粘包问题
+    if(parser->state == kParseFirstLine){
+      // a)HTTP请求的首行，跳过请求之前多余的空行
+      if(*line != '\0'){
+        parser->first_line = line - (conn->in.data + conn->in.pos);
+        parser->state = kParseHeader;
+      }
+    }else if(*line == '\0'){
+      //说明读到了空行，此时 header 部分就结束了
+      parser->state = kParseBody;
+    }else{
+      // b)解析 header 部分
+      HandlerHeader(parser, line, line - (conn->in.data + conn->in.pos));
     }
-  }//end while(1)
+  }
+  // c)body 也要全部收到
+  if(parser->content_length < 0 || parser->content_length > MAX_BODY_SIZE){
+    return -1;
+  }
+  if(conn->in.size - conn->in.pos - parser->scan < (size_t)parser->content_length){
+    return 0;
+  }
+  char* begin = conn->in.data + conn->in.pos;
+  memset(req, 0, sizeof(*req));
+  req->first_line = begin + parser->first_line;
+  req->content_length = parser->content_length;
+  req->body = begin + parser->scan;
+  if(parser->if_none_match > 0){
+    req->if_none_match = begin + parser->if_none_match;
+  }
+  if(parser->if_modified_since > 0){
+    req->if_modified_since = begin + parser->if_modified_since;
+  }
+  conn->in.pos += parser->scan + parser->content_length;
+  int connection = parser->connection;
+  memset(parser, 0, sizeof(*parser));
+  printf("\nfirst_line = %s\n", req->first_line);
+  // d)解析首行，获取到方法，url ，版本号
+  if(ParseFirstLine(req->first_line, &req->method, &req->url, &req->version) < 0){
+    printf("\nParseFirstLine failed! first_line = %s\n", req->first_line);
+    return -1;
+  }
+  //HTTP/1.1 默认是长连接，HTTP/1.0 只有带上 Connection: keep-alive 才是长连接
+  if(strcasecmp(req->version, "HTTP/1.0") == 0){
+    conn->keep_alive = connection == 1;
+  }else{
+    conn->keep_alive = connection != -1;
+  }
+  if(++conn->request_num >= g_max_keepalive_requests){
+    conn->keep_alive = 0;
+  }
+  // e)对 url 再进行解析，解析出其中的 url_path， query_string
+  if(ParseQueryString(req->url, &req->url_path, &req->query_string) < 0){
+    printf("\nParseQueryString failed! url = %s\n", req->url);
+    return -1;
+  }
+  return 1;
 }
 
 //这里有一个坑：
 //stat函数的第一个参数只能是绝对路径！
 int IsDir(const char* file_path){
-  struct stat st; 
+  struct stat st;
   //int ret = stat(file_path, &st);
   int ret = stat(file_path, &st);
   if(ret < 0){
@@ -155,290 +560,1063 @@ int IsDir(const char* file_path){
 //通常的url ：http://www.baidu.com/indel.html
 //服务器看到的路径，也有很多情况下就是/index.html
 //此处暂时只处理第二种情况
-void HandlerFilePath(const char* url_path, char* file_path){
+//file_path 是调用者提供的大小为 size 的缓冲区，请求行最长可以到 MAX_HEADER_SIZE，
+//拼出来的路径放不下时返回 -1，调用者直接返回 404，不能截断或者越界
+int HandlerFilePath(const char* url_path, char* file_path, size_t size){
   //./wwwroot 这个是随意起的名字，此处对于HTTP服务器的根目录名字是没有明确规定的
   //当前服务器要暴露给客户端的文件必须全部放到这个目录下 ：./wwwroot
   //后期可以使用 gflags 这个库将这个路径改为动态生成的,提高程序的可扩展性
   //TODO
-  sprintf(file_path, "/home/zanda/SearchEngines/doc_searcher/http/wwwroot/%s", url_path);
+  int len = snprintf(file_path, size, "/home/zanda/SearchEngines/doc_searcher/http/wwwroot/%s", url_path);
+  if(len < 0 || (size_t)len >= size){
+    return -1;
+  }
   //对于 url_path 还有几种特殊的情况：
   //1.如果url中没有写路径，默认是 /（http服务器的根目录）
   //2.url中写路径了，但是对应的路径是一个目录
   //如果url_path中对应的是一个目录，就尝试访问该目录下的 index.html文件（即入口文件）
-  
+
   //如果url_path最后一个字符是 /，就说明访问的是一个目录
   if(url_path[strlen(url_path)- 1] == '/'){
+    if(len + strlen("index.html") >= size){
+      return -1;
+    }
     strcat(file_path, "index.html");
+    len += strlen("index.html");
   }
   //如果 url_path 最后一个字符不是 /，但是访问的仍然是一个目录
   //此时的核心问题就是要如何识别当前路径是一个目录
   if(IsDir(file_path)){
+    if(len + strlen("/index.html") >= size){
+      return -1;
+    }
     strcat(file_path, "/index.html");
   }
   //printf("file_path : %s\n", file_path);
-  return;
+  return 0;
+}
+
+void StaticFileFree(StaticFile* file){
+  if(file->fd >= 0){
+    close(file->fd);
+  }
+  free(file->url_path);
+  int i = 0;
+  for(; i < 4; ++i){
+    free(file->header[i / 2][i % 2]);
+  }
+  free(file->data);
+  free(file);
+}
+
+void StaticFileRelease(EventLoop* loop, StaticFile* file){
+  if(--file->ref == 0 && file->stale){
+    if(file->data != NULL){
+      loop->static_mem_size -= file->size;
+    }
+    StaticFileFree(file);
+  }
+}
+
+//把 fd 注册到连接所在的事件循环中，使用边缘触发，读写事件都关注
+int AddEvent(Connection* conn, int fd, Handle* handle){
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = handle;
+  return epoll_ctl(conn->loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+//先从 epoll 中删除再关闭。CGI 子进程在 exec 之前还持有这些 fd 的副本，
+//只关闭的话 epoll 中的注册不会消失
+void CloseFd(Connection* conn, int* fd){
+  if(*fd < 0){
+    return;
+  }
+  epoll_ctl(conn->loop->epoll_fd, EPOLL_CTL_DEL, *fd, NULL);
+  close(*fd);
+  *fd = -1;
+}
+
+void CloseUpstream(Connection* conn){
+  if(conn->up_wfd != conn->up_rfd){
+    CloseFd(conn, &conn->up_wfd);
+  }
+  conn->up_wfd = -1;
+  CloseFd(conn, &conn->up_rfd);
+  BufferFree(&conn->up_out);
+}
+
+int64_t MonotonicMs(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//从连接所在的链表（活跃链表或者延迟关闭的链表）中删除
+void UnlinkConnection(Connection* conn){
+  EventLoop* loop = conn->loop;
+  Connection** head = conn->lingering ? &loop->linger_head : &loop->active_head;
+  Connection** tail = conn->lingering ? &loop->linger_tail : &loop->active_tail;
+  if(conn->active_prev != NULL){
+    conn->active_prev->active_next = conn->active_next;
+  }else{
+    *head = conn->active_next;
+  }
+  if(conn->active_next != NULL){
+    conn->active_next->active_prev = conn->active_prev;
+  }else{
+    *tail = conn->active_prev;
+  }
+  conn->active_prev = NULL;
+  conn->active_next = NULL;
 }
 
-size_t GetFileSize(const char* file_path){
-  FILE* fp = fopen(file_path, "r");
-  fseek(fp, 0, SEEK_END);
-  size_t len = ftell(fp);
-  fclose(fp);
-  return len;
+void CloseConnection(Connection* conn){
+  if(conn->closed){
+    return;
+  }
+  conn->closed = 1;
+  CloseUpstream(conn);
+  if(conn->static_file != NULL){
+    StaticFileRelease(conn->loop, conn->static_file);
+    conn->static_file = NULL;
+  }
+  CloseFd(conn, &conn->fd);
+  UnlinkConnection(conn);
+  conn->next_closed = conn->loop->closed;
+  conn->loop->closed = conn;
 }
 
-int WriteStaticFile(int new_sock, char* file_path){
-  //如果打开失败，则文件有可能不存在 
-  printf("file_path = %s\n", file_path); 
-  int fd = open(file_path, O_RDONLY);
+//读出并丢弃客户端发来的数据，读到 0 或者出错时关闭连接
+void DrainLingering(Connection* conn){
+  char buf[SIZE];
+  while(1){
+    ssize_t read_size = read(conn->fd, buf, sizeof(buf));
+    if(read_size > 0){
+      continue;
+    }
+    if(read_size < 0 && errno == EINTR){
+      continue;
+    }
+    if(read_size < 0 && errno == EAGAIN){
+      return;
+    }
+    CloseConnection(conn);
+    return;
+  }
+}
+
+//服务器主动关闭连接（短连接、达到 -n 的限制、请求非法）时，客户端可能已经在发送下一个请求，
+//socket 的接收缓冲区中还有没读的数据就 close 的话内核会发 RST，客户端可能因此丢掉
+//还没有读到的响应。所以先只关闭写端，把客户端后来发的数据都读掉，
+//等客户端关闭或者超过 LINGER_TIMEOUT_MS 之后再真正关闭
+void LingerConnection(Connection* conn){
+  if(conn->eof || shutdown(conn->fd, SHUT_WR) < 0){
+    //客户端已经关闭了写端，不会再有数据
+    CloseConnection(conn);
+    return;
+  }
+  CloseUpstream(conn);
+  if(conn->static_file != NULL){
+    StaticFileRelease(conn->loop, conn->static_file);
+    conn->static_file = NULL;
+  }
+  BufferFree(&conn->in);
+  BufferFree(&conn->out);
+  UnlinkConnection(conn);
+  EventLoop* loop = conn->loop;
+  conn->lingering = 1;
+  conn->last_active_ms = MonotonicMs();
+  conn->active_prev = loop->linger_tail;
+  conn->active_next = NULL;
+  if(loop->linger_tail != NULL){
+    loop->linger_tail->active_next = conn;
+  }else{
+    loop->linger_head = conn;
+  }
+  loop->linger_tail = conn;
+  DrainLingering(conn);
+}
+
+void FreeConnection(Connection* conn){
+  BufferFree(&conn->in);
+  BufferFree(&conn->out);
+  free(conn);
+}
+
+//告诉客户端响应发完之后是否关闭连接
+void WriteConnectionHeader(Connection* conn){
+  BufferAppendStr(&conn->out, conn->keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+}
+
+//url_path 匹配到的最长前缀的缓存时间，没有匹配时返回 -1
+int CacheMaxAge(const char* url_path){
+  int max_age = -1;
+  size_t match_len = 0;
+  int i = 0;
+  for(; i < g_cache_control_rule_num; ++i){
+    const CacheControlRule* rule = &g_cache_control_rules[i];
+    size_t len = strlen(rule->url_prefix);
+    if(len >= match_len && strncmp(url_path, rule->url_prefix, len) == 0){
+      max_age = rule->max_age;
+      match_len = len;
+    }
+  }
+  return max_age;
+}
+
+//根据扩展名确定 Content-Type，不认识的类型就不发送，由浏览器自动识别
+const char* ContentType(const char* file_path){
+  static const char* types[][2] = {
+    {".html", "text/html;charset=utf-8"},
+    {".htm", "text/html;charset=utf-8"},
+    {".css", "text/css"},
+    {".js", "application/javascript"},
+    {".png", "image/png"},
+    {".jpg", "image/jpeg"},
+    {".jpeg", "image/jpeg"},
+    {".gif", "image/gif"},
+    {".ico", "image/x-icon"},
+  };
+  const char* ext = strrchr(file_path, '.');
+  if(ext == NULL || strchr(ext, '/') != NULL){
+    return NULL;
+  }
+  size_t i = 0;
+  for(; i < sizeof(types) / sizeof(types[0]); ++i){
+    if(strcasecmp(ext, types[i][0]) == 0){
+      return types[i][1];
+    }
+  }
+  return NULL;
+}
+
+//打开 url_path 对应的文件，拼好响应头。小文件把内容读到内存中，关闭 fd
+StaticFile* LoadStaticFile(EventLoop* loop, const char* url_path){
+  char file_path[SIZE] = {0};
+  if(HandlerFilePath(url_path, file_path, sizeof(file_path)) < 0){
+    return NULL;
+  }
+  //如果打开失败，则文件有可能不存在
+  printf("file_path = %s\n", file_path);
+  int fd = open(file_path, O_RDONLY | O_CLOEXEC);
   if(fd < 0){
     perror("open");
-    return 404;
+    return NULL;
+  }
+  struct stat st;
+  if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+    close(fd);
+    return NULL;
+  }
+  StaticFile* file = (StaticFile*)calloc(1, sizeof(StaticFile));
+  if(file == NULL){
+    close(fd);
+    return NULL;
   }
-  size_t file_size = GetFileSize(file_path);
+  file->fd = fd;
+  file->url_path = strdup(url_path);
+  if(file->url_path == NULL){
+    StaticFileFree(file);
+    return NULL;
+  }
+  file->size = st.st_size;
+  file->wd = -1;
+  file->mtime = st.st_mtime;
+  snprintf(file->etag, sizeof(file->etag), "\"%llx-%llx.%lx-%llx\"",
+           (unsigned long long)st.st_ino, (unsigned long long)st.st_mtim.tv_sec,
+           (unsigned long)st.st_mtim.tv_nsec, (unsigned long long)st.st_size);
   //给 socket 写入的数据其实是一个HTTP响应
-  const char *first_line = "HTTP/1.1 200 OK\n";
-  //此处需要返回的header重点是两个方面：
-  //a）Constent-Type,可以忽略，浏览器能自动识别数据类型
-  //b) Content-Length,也可以省略，紧接着就会关闭socket
-  char header[SIZE] = {0};
-  sprintf(header, "Content-Length: %lu\n", file_size);
-  const char *blank_line = "\n";
-  send(new_sock, first_line, strlen(first_line), 0);
-  send(new_sock, header, strlen(header), 0);
-  send(new_sock, blank_line, strlen(blank_line), 0);
-  //由于接下来的数据拷贝如果采用 write/read 来进行拷贝
-  //会涉及到频繁的访问 IO设备，导致效率下降
-  //所以这里使用一个特殊的函数，直接在内核中，一次拷贝就解决问题
-  //需要注意的是：这个函数第一个参数必须是一个 socket 
-  sendfile(new_sock, fd, NULL, file_size);
-
-  close(fd);
-  return 200;
+  //此处需要返回的header重点是这几个方面：
+  //a）Constent-Type,浏览器能自动识别数据类型，知道类型的话还是带上
+  //b) Content-Length,长连接上客户端靠它判断响应在哪里结束
+  //c) ETag, Last-Modified, Cache-Control,浏览器缓存文件，之后用条件请求验证，200 和 304 都要带上
+  //这几个 header 的长度都是有限的（ETag 和日期是定长的，Content-Type 来自 ContentType 中的表），
+  //缓冲区按实际需要的大小分配，万一被截断就不缓存这个文件
+  char last_modified[64] = {0};
+  struct tm tm;
+  strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT",
+           gmtime_r(&file->mtime, &tm));
+  char cache_control[32] = {0};
+  int max_age = CacheMaxAge(url_path);
+  if(max_age >= 0){
+    snprintf(cache_control, sizeof(cache_control), "max-age=%d", max_age);
+  }else{
+    snprintf(cache_control, sizeof(cache_control), "no-cache");
+  }
+  char validator[256] = {0};
+  int validator_len = snprintf(validator, sizeof(validator),
+      "ETag: %s\r\nLast-Modified: %s\r\nCache-Control: %s\r\n",
+      file->etag, last_modified, cache_control);
+  char header[256] = {0};
+  int header_len = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\n",
+      (unsigned long)st.st_size);
+  const char* content_type = ContentType(file_path);
+  if(content_type != NULL && header_len >= 0 && (size_t)header_len < sizeof(header)){
+    header_len += snprintf(header + header_len, sizeof(header) - header_len,
+        "Content-Type: %s\r\n", content_type);
+  }
+  if(validator_len < 0 || (size_t)validator_len >= sizeof(validator)
+      || header_len < 0 || (size_t)header_len >= sizeof(header)){
+    printf("static file header too long: %s\n", file_path);
+    StaticFileFree(file);
+    return NULL;
+  }
+  int i = 0;
+  for(; i < 4; ++i){
+    int not_modified = i / 2;
+    int keep_alive = i % 2;
+    char buf[sizeof(header) + sizeof(validator) + 64] = {0};
+    int len = snprintf(buf, sizeof(buf), "%s%s%s\r\n",
+        not_modified ? "HTTP/1.1 304 Not Modified\r\n" : header, validator,
+        keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    file->header[not_modified][keep_alive] = strdup(buf);
+    if(len < 0 || (size_t)len >= sizeof(buf) || file->header[not_modified][keep_alive] == NULL){
+      StaticFileFree(file);
+      return NULL;
+    }
+    file->header_len[not_modified][keep_alive] = len;
+  }
+  if(file->size <= STATIC_MEM_FILE_SIZE
+      && loop->static_mem_size + file->size <= STATIC_MEM_TOTAL_SIZE){
+    //内存不够或者读失败时保留 fd，和大文件一样用 sendfile 发送
+    file->data = (char*)malloc(file->size + 1);
+    ssize_t read_size = file->data != NULL ? pread(fd, file->data, file->size, 0) : -1;
+    if(read_size == (ssize_t)file->size){
+      loop->static_mem_size += file->size;
+      close(fd);
+      file->fd = -1;
+    }else{
+      free(file->data);
+      file->data = NULL;
+    }
+  }
+  //监听文件所在的目录，同一个目录多次 add_watch 返回的是同一个 wd
+  char* slash = strrchr(file_path, '/');
+  *slash = '\0';
+  file->wd = inotify_add_watch(loop->inotify_fd, file_path, IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE
+      | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+  return file;
 }
 
+unsigned int HashUrlPath(const char* url_path){
+  unsigned int hash = 2166136261u;
+  for(; *url_path != '\0'; ++url_path){
+    hash = (hash ^ (unsigned char)*url_path) * 16777619u;
+  }
+  return hash % STATIC_CACHE_BUCKETS;
+}
 
-int HandlerStaticFile(int new_sock, const HttpRequest* req){
-  char file_path[SIZE] = {0};
-  HandlerFilePath(req->url_path, file_path);
-  int err_code = WriteStaticFile(new_sock, file_path);
-  return err_code;
-}
-
-void HandlerCGIFather(int new_sock, int child_pid, int father_read, int father_write, const HttpRequest* req){
-  //1. 对于 POST 把body中的数据写入到管道中
-  char c = '\0';
-  if(strcasecmp(req->method, "POST") == 0){
-    //从socket中读出数据，写入管道中
-    //此处无法使用sendfile， 因为这个函数只能把数据写到socket中。
-    //所以这里采用一个字节一个字节的从socket中读出来，再写到管道中
-    ssize_t i = 0;
-    for(; i < req->content_length; ++i){
-      read(new_sock, &c, 1);
-      write(father_write, &c, 1);
-    }
-  }
-  //2. 父进程需要构造一个完整的HTTP协议数据，对于HTTP协议要求我们按照指定的格式返回数据
-  //对于CGI要求CGI程序返回的结果只是BODY部分，HTTP请求的其他部分需要父进程自己构造
-  //Content-Type 和 Content-Length部分省略
-  const char* first_line = "HTTP/1.1 200 OK\n";
-  const char* blank_line = "\n";
-  const char* content_type = "Content-Type:text/html;charset=utf-8\n"; //之前没有发送这个选项导致有的浏览器无法识别
-  //TODO
-  //后面考虑给响应加上这个选项，使用长连接提高CGI程序的响应速度
-  //const char* connection = "keep-alive"; 
+//查找缓存，没有命中时加载文件并放进缓存。
+//缓存满了或者无法监听文件的变化时，文件不放进缓存，只给这一次请求使用
+StaticFile* StaticCacheGet(EventLoop* loop, const char* url_path){
+  unsigned int bucket = HashUrlPath(url_path);
+  StaticFile* file = loop->static_cache[bucket];
+  for(; file != NULL; file = file->next){
+    if(strcmp(file->url_path, url_path) == 0){
+      return file;
+    }
+  }
+  file = LoadStaticFile(loop, url_path);
+  if(file == NULL){
+    return NULL;
+  }
+  if(file->wd < 0 || loop->static_file_num >= STATIC_CACHE_MAX_FILES){
+    file->stale = 1;
+    return file;
+  }
+  file->next = loop->static_cache[bucket];
+  loop->static_cache[bucket] = file;
+  ++loop->static_file_num;
+  ++file->ref;
+  return file;
+}
+
+//把 wd 对应目录下的文件（wd < 0 时是所有文件）从缓存中移除
+void StaticCacheInvalidate(EventLoop* loop, int wd){
+  int i = 0;
+  for(; i < STATIC_CACHE_BUCKETS; ++i){
+    StaticFile** prev = &loop->static_cache[i];
+    while(*prev != NULL){
+      StaticFile* file = *prev;
+      if(wd >= 0 && file->wd != wd){
+        prev = &file->next;
+        continue;
+      }
+      *prev = file->next;
+      --loop->static_file_num;
+      file->stale = 1;
+      StaticFileRelease(loop, file);
+    }
+  }
+}
+
+void OnInotifyEvent(EventLoop* loop){
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while(1){
+    ssize_t len = read(loop->inotify_fd, buf, sizeof(buf));
+    if(len <= 0){
+      return;
+    }
+    char* p = buf;
+    while(p < buf + len){
+      struct inotify_event* event = (struct inotify_event*)p;
+      //事件太多，队列溢出时不知道哪些文件变了，清空整个缓存
+      StaticCacheInvalidate(loop, (event->mask & IN_Q_OVERFLOW) ? -1 : event->wd);
+      p += sizeof(struct inotify_event) + event->len;
+    }
+  }
+}
 
-  send(new_sock, first_line, strlen(first_line), 0);
-  send(new_sock, content_type, strlen(content_type), 0);
-  send(new_sock, blank_line, strlen(blank_line), 0);
-  //send(new_sock, connection, strlen(connection), 0);
+//浏览器缓存的文件是否还是最新的。有 If-None-Match 时只比较 ETag，忽略 If-Modified-Since
+int IsNotModified(const HttpRequest* req, const StaticFile* file){
+  if(req->if_none_match != NULL){
+    //可能是逗号分隔的多个 ETag，或者是 *，W/ 前缀表示弱验证，同样按值比较
+    return strcmp(req->if_none_match, "*") == 0 || strstr(req->if_none_match, file->etag) != NULL;
+  }
+  if(req->if_modified_since != NULL){
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(req->if_modified_since, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return end != NULL && file->mtime <= timegm(&tm);
+  }
+  return 0;
+}
 
-  //3. 从管道中尝试读取数据，写回到socket中，father_read对应的是child_write,对于父进程来说
-  //child_write 已经关闭了，对于子进程来说，如果CGI程序处理完进程就推出了，进程退出就会关闭
-  //child_write,此时就意味着管道的所有写端都关闭，再尝试读，read返回0
-  printf("father will be read & write!\n");
-  while(read(father_read, &c, 1) > 0){
-    write(new_sock, &c, 1);
+int HandlerStaticFile(Connection* conn){
+  StaticFile* file = StaticCacheGet(conn->loop, conn->req.url_path);
+  if(file == NULL){
+    return 404;
   }
-  //4. 进行进程等待
-  //这里不能使用wait，因为服务器会给每一个客户都创建一个线程，每个线程又很可能创建子进程
-  //如果是wait等待，那么任何一个子进程结束都可能导致wait返回，这样子进程就不是由对应的线程
-  //来回收了
-  waitpid(child_pid, NULL, 0);
+  ++file->ref;
+  conn->static_file = file;
+  conn->static_sent = 0;
+  conn->not_modified = IsNotModified(&conn->req, file);
+  return 200;
 }
 
-void HandlerCGIChild(int child_read, int child_write,const HttpRequest* req){
+//发送静态文件的响应：内存中的文件用 writev 把响应头和内容一起发出去，
+//大文件先发响应头，再用 sendfile 发送文件，直接在内核中拷贝，304 只发响应头。
+//socket 写不进去的时候记下已经发送的字节数，等可写之后继续
+int SendStaticFile(Connection* conn){
+  StaticFile* file = conn->static_file;
+  const char* header = file->header[conn->not_modified][conn->keep_alive];
+  size_t header_len = file->header_len[conn->not_modified][conn->keep_alive];
+  size_t total = header_len + (conn->not_modified ? 0 : file->size);
+  while(conn->static_sent < total){
+    size_t sent = conn->static_sent;
+    ssize_t n = 0;
+    if(file->data != NULL){
+      struct iovec iov[2];
+      int iov_num = 0;
+      if(sent < header_len){
+        iov[iov_num].iov_base = (void*)(header + sent);
+        iov[iov_num].iov_len = header_len - sent;
+        ++iov_num;
+        sent = header_len;
+      }
+      iov[iov_num].iov_base = file->data + (sent - header_len);
+      iov[iov_num].iov_len = total - sent;
+      ++iov_num;
+      n = writev(conn->fd, iov, iov_num);
+    }else if(sent < header_len){
+      n = send(conn->fd, header + sent, header_len - sent,
+               MSG_NOSIGNAL | (total > header_len ? MSG_MORE : 0));
+    }else{
+      off_t offset = sent - header_len;
+      n = sendfile(conn->fd, file->fd, &offset, total - sent);
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)){
+      return 0;
+    }
+    if(n <= 0){
+      return -1;
+    }
+    conn->static_sent += n;
+  }
+  return 1;
+}
+
+//对于CGI要求CGI程序返回的结果只是BODY部分，HTTP请求的其他部分需要自己构造
+//body 的长度事先不知道：HTTP/1.1 的长连接上使用 chunked 编码，
+//否则省略 Content-Length，body 发完之后关闭连接
+void WriteDynamicHeader(Connection* conn){
+  const char* first_line = "HTTP/1.1 200 OK\r\n";
+  const char* blank_line = "\r\n";
+  const char* content_type = "Content-Type:text/html;charset=utf-8\r\n"; //之前没有发送这个选项导致有的浏览器无法识别
+  if(strcasecmp(conn->req.version, "HTTP/1.0") == 0){
+    conn->keep_alive = 0;
+  }
+  conn->chunked = conn->keep_alive;
+  BufferAppendStr(&conn->out, first_line);
+  BufferAppendStr(&conn->out, content_type);
+  if(conn->chunked){
+    BufferAppendStr(&conn->out, "Transfer-Encoding: chunked\r\n");
+  }
+  WriteConnectionHeader(conn);
+  BufferAppendStr(&conn->out, blank_line);
+}
+
+//CGI 是一种协议， 约定了HTTP服务器如何生成动态页面，HTTP服务器需要创建子进程，子进程进行
+//程序替换。子进程的标准输入和标准输出都重定向到管道，父进程这一端的管道设置成非阻塞，
+//注册到事件循环中：POST 的 body 写到子进程的标准输入，子进程的输出转发给客户端
+int HandlerCGI(Connection* conn){
+  const HttpRequest* req = &conn->req;
   //1. 创建环境变量，以至于进程替换之后依然可用那些必须的数据
   //REQUEST_METHOD, QUERY_STRING, CONTENT_LENGTH
+  //多线程的程序 fork 之后子进程中只能调用 async-signal-safe 的函数，
+  //所以环境变量和路径都在 fork 之前准备好，子进程中用 execle 传进去
   char method_env[SIZE] = {0};
+  char arg_env[SIZE] = {0};
   //拼接字符串：REQUEST_METHOD=GET
-  sprintf(method_env, "REQUEST_METHOD=%s", req->method);
-  putenv(method_env);
+  snprintf(method_env, sizeof(method_env), "REQUEST_METHOD=%s", req->method);
   if(strcasecmp(req->method, "GET") == 0){
-    //设置QUERY_STRING
-    char query_string_env[SIZE] = {0};
-  
-    sprintf(query_string_env, "QUERY_STRING=%s", req->query_string);
-    putenv(query_string_env);
+    snprintf(arg_env, sizeof(arg_env), "QUERY_STRING=%s", req->query_string);
   }else{
-    //设置CONTENT_LENGTH
-    char content_length_env[SIZE] = {0};
-    sprintf(content_length_env, "CONTENT_LENGTH=%d", req->content_length);
-    putenv(content_length_env);
-  }
-  //2. 重定向，将子进程的标准输入和标准输出重定向到管道
-  printf("will be exchage!\n");
-  dup2(child_read, 0);
-  dup2(child_write, 1);
-  //3. 进程的程序替换
+    snprintf(arg_env, sizeof(arg_env), "CONTENT_LENGTH=%d", req->content_length);
+  }
+  char* envp[] = {method_env, arg_env, NULL};
   char file_path[SIZE] = {0};
-  HandlerFilePath(req->url_path, file_path);
-  //第一个参数是路径，第二个参数是命令行参数,第三个参数是NULL结尾
-  execl(file_path, file_path, NULL);
-  //4. 错误处理：如果execl执行失败
-  //如果此处不退出，则会出现子进程和父进程监听相同端口号的情况，而我们只希望子进程取调用CGI程序，处理
-  //客户端连接这样的事情应该只由父进程来完成
-  exit(0); 
-}
-
-
-//CGI 是一种协议， 约定了HTTP服务器如何生成动态页面，HTTP服务器需要创建子进程，子进程进行
-//程序替换，
-int HandlerCGI(int new_sock, const HttpRequest* req){
-  int err_code = 200;
-  //1.创建一对管道
+  if(HandlerFilePath(req->url_path, file_path, sizeof(file_path)) < 0){
+    return 404;
+  }
+  //2.创建一对管道
   int fd1[2], fd2[2];
-  pipe(fd1);
-  pipe(fd2);
+  if(pipe2(fd1, O_CLOEXEC) < 0){
+    return 404;
+  }
+  if(pipe2(fd2, O_CLOEXEC) < 0){
+    close(fd1[0]);
+    close(fd1[1]);
+    return 404;
+  }
   int father_read = fd1[0];
   int child_write = fd1[1];
   int father_write = fd2[1];
   int child_read = fd2[0];
-
-  //2.创建子进程
+  //3.创建子进程
   pid_t ret = fork();
-  //3.父进程流程
-  if(ret > 0){
-    close(child_read);
-    close(child_write);
-    HandlerCGIFather(new_sock, ret, father_read, father_write, req);
-  }else if(ret == 0){
-  //4.子进程流程
+  if(ret == 0){
+    //4.子进程流程：重定向之后进行程序替换。dup2 出来的 fd 没有 O_CLOEXEC，
+    //其他的 fd（包括客户端的 socket）在 exec 时都会被关掉
+    dup2(child_read, 0);
+    dup2(child_write, 1);
+    //第一个参数是路径，第二个参数是命令行参数,以NULL结尾，最后是环境变量
+    execle(file_path, file_path, (char*)NULL, envp);
+    //错误处理：如果execle执行失败，子进程直接退出
+    _exit(1);
+  }
+  close(child_read);
+  close(child_write);
+  if(ret < 0){
     close(father_read);
     close(father_write);
-    HandlerCGIChild(child_read, child_write, req);
+    return 404;
+  }
+  //5.父进程流程
+  //子进程退出时由内核直接回收（SIGCHLD 设置成了 SIG_IGN），不需要 waitpid
+  fcntl(father_read, F_SETFL, fcntl(father_read, F_GETFL) | O_NONBLOCK);
+  //管道默认只有 64KB，加大之后子进程可以一次写完整个页面，不用等父进程转发。
+  //超过了系统的上限（/proc/sys/fs/pipe-max-size）时失败，保持默认大小就可以
+  fcntl(father_read, F_SETPIPE_SZ, CGI_PIPE_SIZE);
+  fcntl(father_write, F_SETFL, fcntl(father_write, F_GETFL) | O_NONBLOCK);
+  conn->up_rfd = father_read;
+  conn->up_wfd = father_write;
+  if(strcasecmp(req->method, "GET") != 0){
+    BufferAppend(&conn->up_out, req->body, req->content_length);
+  }
+  if(AddEvent(conn, father_read, &conn->upstream_handle) < 0
+      || AddEvent(conn, father_write, &conn->upstream_handle) < 0){
+    CloseUpstream(conn);
+    return 404;
+  }
+  WriteDynamicHeader(conn);
+  return 200;
+}
+
+//动态页面交给常驻的前端进程生成，不再每次都 fork/exec CGI 程序，
+//前端进程中的 RPC 连接和模板都是加载好的。协议和 CGI 一一对应：
+//先发送一行 "GET <QUERY_STRING>" 或者 "POST <CONTENT_LENGTH>"，POST 再跟着 body，
+//前端进程写回 html 页面之后关闭连接
+int HandlerFrontend(Connection* conn){
+  const HttpRequest* req = &conn->req;
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if(fd < 0){
+    perror("socket");
+    return 404;
+  }
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, g_frontend_sock_path, sizeof(addr.sun_path) - 1);
+  //unix socket 的 connect 不会返回 EINPROGRESS，失败就是前端进程没有启动或者太忙了
+  if(connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0){
+    perror("connect frontend");
+    close(fd);
+    return 404;
+  }
+  //query_string 的长度只受请求行的限制，直接追加到缓冲区里，不经过定长的数组
+  if(strcasecmp(req->method, "GET") == 0){
+    BufferAppendStr(&conn->up_out, "GET ");
+    BufferAppendStr(&conn->up_out, req->query_string);
+    BufferAppendStr(&conn->up_out, "\n");
   }else{
-    err_code = 404;
+    char line[32] = {0};
+    snprintf(line, sizeof(line), "POST %d\n", req->content_length);
+    BufferAppendStr(&conn->up_out, line);
+    BufferAppend(&conn->up_out, req->body, req->content_length);
+  }
+  conn->up_rfd = conn->up_wfd = fd;
+  if(AddEvent(conn, fd, &conn->upstream_handle) < 0){
+    CloseUpstream(conn);
+    return 404;
   }
-  return err_code;
+  //和 CGI 一样，body 之外的部分由 HTTP 服务器构造
+  WriteDynamicHeader(conn);
+  return 200;
+}
+
+//有前端进程时交给前端进程，否则按照 CGI 协议处理
+int HandlerDynamic(Connection* conn){
+  if(g_frontend_sock_path != NULL){
+    return HandlerFrontend(conn);
+  }
+  return HandlerCGI(conn);
 }
 
 //明天把这里更改为调用外部的静态html资源来展示404页面
-void Handler404(int new_sock){
+void Handler404(Connection* conn){
   //构造一个错误处理的页面,严格遵守HTTP响应的格式
-  const char* first_line = "HTTP/1.1 404 Not Found\n"; 
-  const char *blank_line = "\n";
+  const char* first_line = "HTTP/1.1 404 Not Found\r\n";
+  const char *blank_line = "\r\n";
   //body 部分的内容就是HTML
   const char *body ="<head><meta http-equiv=\"content-type\""
-                    "content=\"text/html;charset=utf-8\"></head>" 
+                    "content=\"text/html;charset=utf-8\"></head>"
                     "<h1>你的页面被喵星人吃掉了！！！</h1>";
   char content_length[SIZE] = { 0 };
-  sprintf(content_length, "Content-Length: %lu\n", strlen(body));
-  send(new_sock, first_line, strlen(first_line), 0);
-  send(new_sock, content_length, strlen(content_length), 0);
-  send(new_sock, blank_line, strlen(blank_line), 0);
-  send(new_sock, body, strlen(body), 0);
-
+  sprintf(content_length, "Content-Length: %lu\r\n", strlen(body));
+  BufferAppendStr(&conn->out, first_line);
+  BufferAppendStr(&conn->out, content_length);
+  WriteConnectionHeader(conn);
+  BufferAppendStr(&conn->out, blank_line);
+  BufferAppendStr(&conn->out, body);
 }
 
-void HandlerRequest(int64_t new_sock){
-  //1.读取请求并解析
-  // a)从 socket 中读出HTTP请求的首行
+//请求已经完整地解析出来了，准备好响应。ret 是 ParseRequest 的返回值
+void HandlerRequest(Connection* conn, int ret){
   int err_code = 200;
-  HttpRequest req;
-  memset(&req, 0, sizeof(req));
-  if(ReadLine(new_sock, req.first_line, sizeof(req.first_line) - 1) < 0){
-    printf("\nReadLine first_line failed\n");
-    //  简略考虑，对于错误的处理情况，统一返回404
-    err_code = 404;
-    goto END;
-  }
-  printf("\nfirst_line = %s\n", req.first_line); //OK
-  // b)解析首行，获取到方法，url ，版本号（暂不考虑）
-  if(ParseFirstLine(req.first_line, &req.method, &req.url) < 0){
-    printf("\nParseFirstLine failed! first_line = %s\n", req.first_line);
-    err_code = 404;
-    goto END;
-  }
-  // c)对 url 再进行解析，解析出其中的 url_path， query_string
-  if(ParseQueryString(req.url, &req.url_path, &req.query_string) < 0){
-    printf("\nParseQueryString failed! url = %s\n", req.url);
-    err_code = 404;
-    goto END;
-  }
-  // d)读取并解析 header 部分（简略考虑，只保留content_length，其他的header 内容直接丢弃
-  //   后面自己做的时候，把有用的部分都保存下来
-  if(HandlerHeader(new_sock, &req.content_length) < 0){
-    printf("HandlerHeader faild!\n");
+  HttpRequest* req = &conn->req;
+  conn->responding = 1;
+  if(ret < 0){
+    //  简略考虑，对于错误的处理情况，统一返回404。
+    //  非法的请求之后无法找到下一个请求的开头，发完响应就关闭连接
+    conn->keep_alive = 0;
     err_code = 404;
     goto END;
   }
-  //2.根据请求的详细情况执行静态页面逻辑还是动态页面逻辑
+  //根据请求的详细情况执行静态页面逻辑还是动态页面逻辑
   // a)如果是GET请求，并且没有query_string，就认为是静态页面
   // b)如果是GET请求，并且有query_string，就可以根据query_string参数内容来动态计算生成页面了
   // c)如果是POST请求，就认为是动态页面（简略考虑）
   // d)如果是其他请求，简略考虑不支持其他请求，如果是真实的HTTP服务器，还是要支持其他的请求的
-  if(strcasecmp(req.method, "GET") == 0 && req.query_string == NULL){
+  if(strcasecmp(req->method, "GET") == 0 && req->query_string == NULL){
     //生成静态页面
-    err_code = HandlerStaticFile(new_sock, &req);
-  }else if(strcasecmp(req.method, "GET") == 0 && req.query_string != NULL){
-    printf("url_path = %s\n", req.url_path);
-    printf("query_string = %s\n", req.query_string);
-    printf("Get-> CGI start\n");
-    err_code = HandlerCGI(new_sock, &req);
-  }else if(strcasecmp(req.method, "PUT") == 0){
-    printf("Put-> CGI start\n");
-    err_code = HandlerCGI(new_sock, &req);
+    err_code = HandlerStaticFile(conn);
+  }else if(strcasecmp(req->method, "GET") == 0 && req->query_string != NULL){
+    printf("url_path = %s\n", req->url_path);
+    printf("query_string = %s\n", req->query_string);
+    err_code = HandlerDynamic(conn);
+  }else if(strcasecmp(req->method, "PUT") == 0){
+    err_code = HandlerDynamic(conn);
   }else{
     //为了简略考虑，其他方法不支持处理
-    printf("method not support! method = %s\n", req.method);
+    printf("method not support! method = %s\n", req->method);
     err_code = 404;
-    goto END;
   }
 END:
-  //这里处理收尾工作
   if(err_code != 200){
-    Handler404(new_sock);
+    Handler404(conn);
+  }
+}
+
+//把缓冲区中的数据尽量写到 fd 中，写不进去时返回 0，出错返回 -1
+int FlushBuffer(int fd, Buffer* buf){
+  while(buf->pos < buf->size){
+    ssize_t write_size = write(fd, buf->data + buf->pos, buf->size - buf->pos);
+    if(write_size < 0){
+      return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    buf->pos += write_size;
+  }
+  buf->pos = buf->size = 0;
+  return 0;
+}
+
+//把 out 中的数据发给客户端。后面紧跟着要用 sendfile/splice 发送 body 时带上 MSG_MORE，
+//让内核把响应头（或者块长度）和 body 合并到同一个 TCP 报文中
+int FlushOutput(Connection* conn){
+  int flags = MSG_NOSIGNAL;
+  if(conn->static_file != NULL || conn->splice_remain > 0){
+    flags |= MSG_MORE;
+  }
+  Buffer* buf = &conn->out;
+  while(buf->pos < buf->size){
+    ssize_t write_size = send(conn->fd, buf->data + buf->pos, buf->size - buf->pos, flags);
+    if(write_size < 0){
+      return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    buf->pos += write_size;
+  }
+  buf->pos = buf->size = 0;
+  return 0;
+}
+
+//把 CGI 子进程的输出从管道直接 splice 到 socket，数据不用拷贝到用户态。
+//只 splice 管道中已有的字节数，EAGAIN 一定是 socket 写不进去了
+int SpliceOutput(Connection* conn){
+  while(conn->splice_remain > 0){
+    ssize_t n = splice(conn->up_rfd, NULL, conn->fd, NULL, conn->splice_remain,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)){
+      return 0;
+    }
+    if(n <= 0){
+      return -1;
+    }
+    conn->splice_remain -= n;
+  }
+  //这一块发完了，chunked 编码时块的数据后面还要跟一个 \r\n
+  if(conn->chunked){
+    BufferAppendStr(&conn->out, "\r\n");
+  }
+  return 1;
+}
+
+//chunked 编码时在 out 的末尾加上块长度那一行
+void AppendChunkHeader(Connection* conn, size_t size){
+  char chunk_header[CHUNK_HEADER_SIZE + 1] = {0};
+  snprintf(chunk_header, sizeof(chunk_header), "%lx\r\n", (unsigned long)size);
+  BufferAppendStr(&conn->out, chunk_header);
+}
+
+//尽可能地推进响应的发送。返回 1 表示响应已经全部发完，0 表示要等下一次事件，-1 表示出错
+int PumpResponse(Connection* conn){
+  while(1){
+    //1. 先发送 out 中的数据（响应头，或者已经从上游读出来的 body）
+    if(FlushOutput(conn) < 0){
+      return -1;
+    }
+    if(conn->out.pos < conn->out.size){
+      return 0;
+    }
+    //2. 静态页面：发送缓存中的响应头和文件
+    if(conn->static_file != NULL){
+      int ret = SendStaticFile(conn);
+      if(ret <= 0){
+        return ret;
+      }
+      StaticFileRelease(conn->loop, conn->static_file);
+      conn->static_file = NULL;
+      return 1;
+    }
+    if(conn->up_rfd < 0){
+      return 1;
+    }
+    //3. 动态页面：先把请求发给前端进程或者 CGI 子进程，CGI 的 body 写完之后
+    //   关闭子进程的标准输入
+    if(conn->up_wfd >= 0){
+      if(FlushBuffer(conn->up_wfd, &conn->up_out) < 0){
+        return -1;
+      }
+      if(conn->up_out.size == 0 && conn->up_wfd != conn->up_rfd){
+        CloseFd(conn, &conn->up_wfd);
+      }
+    }
+    //   再把它们的输出转发给客户端。客户端写不进去时不再从上游读，
+    //   数据留在管道或者 socket 的缓冲区中，不会无限占用内存
+    //   a) CGI 的输出是管道，管道中有多少数据就 splice 多少
+    if(conn->splice_remain > 0){
+      int ret = SpliceOutput(conn);
+      if(ret <= 0){
+        return ret;
+      }
+      continue;
+    }
+    int available = 0;
+    if(conn->up_wfd != conn->up_rfd && ioctl(conn->up_rfd, FIONREAD, &available) == 0
+        && available > 0){
+      if(conn->chunked){
+        AppendChunkHeader(conn, available);
+      }
+      conn->splice_remain = available;
+      continue;
+    }
+    //   b) 前端进程的 unix socket 不能 splice，或者管道中暂时没有数据（需要区分是写完了
+    //      还是要等待），读到 out 中，回到第 1 步发送给客户端。
+    //      此时 out 一定是空的，chunked 编码时在数据前面预留出块长度那一行的位置，
+    //      读完之后再把这一行填到数据前面，不需要挪动数据
+    const size_t reserved = conn->chunked ? CHUNK_HEADER_SIZE : 0;
+    if(BufferReserve(&conn->out, reserved + RELAY_BUFFER_SIZE + 2) < 0){
+      return -1;
+    }
+    ssize_t read_size = read(conn->up_rfd, conn->out.data + reserved, RELAY_BUFFER_SIZE);
+    if(read_size < 0){
+      return errno == EAGAIN || errno == EINTR ? 0 : -1;
+    }
+    if(read_size == 0){
+      //前端进程或者 CGI 子进程写完了，chunked 编码时用一个长度为 0 的块表示结束
+      CloseUpstream(conn);
+      if(conn->chunked){
+        BufferAppendStr(&conn->out, "0\r\n\r\n");
+      }
+      continue;
+    }
+    conn->out.size = reserved + read_size;
+    if(conn->chunked){
+      char chunk_header[CHUNK_HEADER_SIZE + 1] = {0};
+      int n = snprintf(chunk_header, sizeof(chunk_header), "%lx\r\n", (unsigned long)read_size);
+      conn->out.pos = reserved - n;
+      memcpy(conn->out.data + conn->out.pos, chunk_header, n);
+      BufferAppendStr(&conn->out, "\r\n");
+    }
+  }
+}
+
+//读出客户端发来的数据，长连接上客户端可能一次发送多个请求（pipelining），都先放在读缓冲区中。
+//每次至少读 SIZE 个字节，一次 read 通常就能读到整个请求，读到的数据少于缓冲区的空闲空间时
+//说明 socket 中已经没有数据了，不再多调用一次 read 去等 EAGAIN（边缘触发时新的数据到来会有新的事件）。
+//只有对端关闭了写端（EPOLLRDHUP）时才一直读到 0
+int ReadRequest(Connection* conn, uint32_t events){
+  while(!conn->eof){
+    //积压的数据太多时先不读，等前面的请求处理完再读，数据留在 socket 的缓冲区中
+    if(conn->in.size - conn->in.pos > MAX_HEADER_SIZE + MAX_BODY_SIZE){
+      conn->read_blocked = 1;
+      return 0;
+    }
+    if(BufferReserve(&conn->in, SIZE) < 0){
+      return -1;
+    }
+    size_t space = conn->in.cap - conn->in.size;
+    ssize_t read_size = read(conn->fd, conn->in.data + conn->in.size, space);
+    if(read_size < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      if(errno == EAGAIN){
+        break;
+      }
+      return -1;
+    }
+    if(read_size == 0){
+      //对端关闭了写端（可能是发完请求之后调用了 shutdown），已经收到的请求还是要处理完
+      conn->eof = 1;
+      break;
+    }
+    conn->in.size += read_size;
+    if((size_t)read_size < space && !(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))){
+      break;
+    }
+  }
+  conn->read_blocked = 0;
+  return 0;
+}
+
+//推进连接上的处理：解析读缓冲区中的请求、发送响应，长连接上一个响应发完之后
+//按顺序接着处理缓冲区中的下一个请求。返回 -1 表示需要立即关闭连接，
+//返回 1 表示最后一个响应已经发完，需要延迟关闭连接
+int ProcessConnection(Connection* conn){
+  while(1){
+    if(!conn->responding){
+      int ret = ParseRequest(conn);
+      if(ret == 0 && conn->read_blocked){
+        //前面的请求处理完了，把积压在 socket 中的数据读出来
+        if(ReadRequest(conn, 0) < 0){
+          return -1;
+        }
+        ret = ParseRequest(conn);
+      }
+      if(ret == 0){
+        //请求还不完整，对端已经关闭了写端的话就不会再有数据了
+        return conn->eof ? -1 : 0;
+      }
+      HandlerRequest(conn, ret);
+    }
+    int ret = PumpResponse(conn);
+    if(ret <= 0){
+      return ret;
+    }
+    //一个响应发完了，短连接关闭
+    if(!conn->keep_alive){
+      return 1;
+    }
+    conn->responding = 0;
+    conn->chunked = 0;
+  }
+}
+
+//连接上有读写时移到活跃链表的末尾
+void TouchConnection(Connection* conn, int64_t now_ms){
+  EventLoop* loop = conn->loop;
+  conn->last_active_ms = now_ms;
+  if(loop->active_tail == conn){
+    return;
+  }
+  if(conn->active_prev != NULL){
+    conn->active_prev->active_next = conn->active_next;
+  }else if(loop->active_head == conn){
+    loop->active_head = conn->active_next;
+  }
+  if(conn->active_next != NULL){
+    conn->active_next->active_prev = conn->active_prev;
+  }
+  conn->active_prev = loop->active_tail;
+  conn->active_next = NULL;
+  if(loop->active_tail != NULL){
+    loop->active_tail->active_next = conn;
+  }else{
+    loop->active_head = conn;
+  }
+  loop->active_tail = conn;
+}
+
+void OnClientEvent(Connection* conn, uint32_t events){
+  if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+    if(ReadRequest(conn, events) < 0){
+      CloseConnection(conn);
+      return;
+    }
+  }
+  int ret = ProcessConnection(conn);
+  if(ret < 0){
+    CloseConnection(conn);
+  }else if(ret > 0){
+    LingerConnection(conn);
+  }
+}
+
+void OnUpstreamEvent(Connection* conn){
+  int ret = ProcessConnection(conn);
+  if(ret < 0){
+    CloseConnection(conn);
+  }else if(ret > 0){
+    LingerConnection(conn);
   }
-  //此处我们只考虑短连接（每次客户端（浏览器）给服务器发送请求之前，都是新建立一个 socket 进行连接
-  //对于短连接而言，只要响应写完，就可以关闭 new_sock
-  //TODO
-  close(new_sock);
 }
 
-void* ThreadEntry(void *arg){
-  //线程入口函数，负责一次请求的完整过程
-  int64_t new_sock = *(int64_t*)arg;
-  printf("Thread Start!\n");
-  HandlerRequest(new_sock); 
+void AddConnection(EventLoop* loop, int new_sock){
+  Connection* conn = (Connection*)calloc(1, sizeof(Connection));
+  if(conn == NULL){
+    close(new_sock);
+    return;
+  }
+  conn->fd = new_sock;
+  conn->loop = loop;
+  conn->client_handle.type = kHandleClient;
+  conn->client_handle.conn = conn;
+  conn->upstream_handle.type = kHandleUpstream;
+  conn->upstream_handle.conn = conn;
+  conn->up_rfd = conn->up_wfd = -1;
+  //动态页面是边生成边转发的，每一块都要立刻发出去，不能被 Nagle 算法攒着等 ACK
+  int opt = 1;
+  setsockopt(new_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  if(AddEvent(conn, new_sock, &conn->client_handle) < 0){
+    perror("epoll_ctl");
+    close(new_sock);
+    free(conn);
+    return;
+  }
+  TouchConnection(conn, MonotonicMs());
+}
+
+//从队列中取出新连接。g_conn_event_fd 是信号量模式，每次 read 减一，对应队列中的一个连接，
+//每次最多取一小批，剩下的留给其他工作线程
+void OnConnQueueEvent(EventLoop* loop){
+  int i = 0;
+  for(; i < 16; ++i){
+    uint64_t token = 0;
+    if(read(g_conn_event_fd, &token, sizeof(token)) < 0){
+      return;
+    }
+    int new_sock = -1;
+    if(ConnQueuePop(&g_conn_queue, &new_sock) < 0){
+      //排在前面的生产者还没有写完，把计数还回去，稍后再取
+      token = 1;
+      write(g_conn_event_fd, &token, sizeof(token));
+      return;
+    }
+    AddConnection(loop, new_sock);
+  }
+}
+
+void* EventLoopRun(void* arg){
+  EventLoop* loop = (EventLoop*)arg;
+  struct epoll_event events[MAX_EVENTS];
+  while(1){
+    //至少每秒醒来一次，检查空闲超时的连接
+    int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, 1000);
+    if(n < 0){
+      if(errno != EINTR){
+        perror("epoll_wait");
+      }
+      n = 0;
+    }
+    int64_t now_ms = MonotonicMs();
+    int i = 0;
+    for(; i < n; ++i){
+      Handle* handle = (Handle*)events[i].data.ptr;
+      if(handle->type == kHandleConnQueue){
+        OnConnQueueEvent(loop);
+        continue;
+      }
+      if(handle->type == kHandleInotify){
+        OnInotifyEvent(loop);
+        continue;
+      }
+      Connection* conn = handle->conn;
+      if(conn->closed){
+        continue;
+      }
+      if(conn->lingering){
+        if(handle->type == kHandleClient){
+          DrainLingering(conn);
+        }
+        continue;
+      }
+      TouchConnection(conn, now_ms);
+      if(handle->type == kHandleClient){
+        OnClientEvent(conn, events[i].events);
+      }else{
+        OnUpstreamEvent(conn);
+      }
+    }
+    while(loop->active_head != NULL
+        && now_ms - loop->active_head->last_active_ms >= g_idle_timeout_ms){
+      CloseConnection(loop->active_head);
+    }
+    while(loop->linger_head != NULL
+        && now_ms - loop->linger_head->last_active_ms >= LINGER_TIMEOUT_MS){
+      CloseConnection(loop->linger_head);
+    }
+    while(loop->closed != NULL){
+      Connection* conn = loop->closed;
+      loop->closed = conn->next_closed;
+      FreeConnection(conn);
+    }
+  }
   return NULL;
 }
 
-void HttpServerStart(const char *ip, short port)
-{
-  //忽略掉写管道破裂信号，避免由于客户端在特殊情况下(eg: 等待服务器响应时间过长)而主动断开连接，从而
-  //导致服务器向一个已经关闭的socket信道写数据，导致引发写管道破裂信号强制关闭HTTP服务器进程
-  signal(SIGPIPE, SIG_IGN);
+int CreateListenSocket(const char *ip, short port){
   //创建 tcp socket
-  int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+  int listen_sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
   if(listen_sock < 0){
     perror("socket");;
-    return;
+    return -1;
   }
   //设置 REUSEADDR，将端口设置为可重用式，解决短连接主动关闭 socket 出现大量 time_wait 状态的问题
   int opt = 1;
   setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-  //绑定端口号 
+  //绑定端口号
   sockaddr_in addr;
   addr.sin_family = AF_INET;
   addr.sin_addr.s_addr = inet_addr(ip);
@@ -446,35 +1624,185 @@ void HttpServerStart(const char *ip, short port)
   int ret = bind(listen_sock, (sockaddr*)&addr, sizeof(addr));
   if(ret < 0){
     perror("bind");
-    return;
+    close(listen_sock);
+    return -1;
   }
-  ret = listen(listen_sock, 5);
+  ret = listen(listen_sock, SOMAXCONN);
   if(ret < 0){
     perror("listen");
-    return;
+    close(listen_sock);
+    return -1;
   }
-  printf("Server Start!\n");
+  return listen_sock;
+}
+
+//主线程只负责 accept，新连接通过无锁队列交给固定数量的工作线程，不再为每个连接创建线程。
+//队列满了说明工作线程处理不过来，直接返回 503，不再让连接继续排队
+void AcceptLoop(int listen_sock){
+  const char* overload = "HTTP/1.1 503 Service Unavailable\r\n"
+                         "Content-Length: 0\r\nConnection: close\r\n\r\n";
   while(1){
-    sockaddr_in peer;
-    socklen_t len = sizeof(peer);
-    int64_t new_sock = accept(listen_sock, (sockaddr*)&peer, &len);
+    int new_sock = accept4(listen_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
     if(new_sock < 0){
       perror("accept");
+      if(errno == EMFILE || errno == ENFILE){
+        //文件描述符用完了，等连接关闭一些之后再 accept
+        usleep(10 * 1000);
+      }
+      continue;
+    }
+    if(ConnQueuePush(&g_conn_queue, new_sock) < 0){
+      printf("connection queue full!\n");
+      write(new_sock, overload, strlen(overload));
+      close(new_sock);
+      continue;
+    }
+    uint64_t token = 1;
+    write(g_conn_event_fd, &token, sizeof(token));
+  }
+}
+
+//工作线程各自运行一个事件循环（默认和 CPU 核数相同），
+//所有的 socket 都是非阻塞的，一个线程可以同时处理大量的连接
+void HttpServerStart(const char *ip, short port)
+{
+  //忽略掉写管道破裂信号，避免由于客户端在特殊情况下(eg: 等待服务器响应时间过长)而主动断开连接，从而
+  //导致服务器向一个已经关闭的socket信道写数据，导致引发写管道破裂信号强制关闭HTTP服务器进程
+  signal(SIGPIPE, SIG_IGN);
+  //CGI 子进程退出时由内核直接回收，不会变成僵尸进程
+  signal(SIGCHLD, SIG_IGN);
+  int listen_sock = CreateListenSocket(ip, port);
+  if(listen_sock < 0){
+    return;
+  }
+  g_conn_event_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC);
+  if(g_conn_event_fd < 0 || ConnQueueInit(&g_conn_queue, g_conn_queue_size) < 0){
+    perror("eventfd");
+    return;
+  }
+  long worker_num = g_worker_num > 0 ? g_worker_num : sysconf(_SC_NPROCESSORS_ONLN);
+  if(worker_num < 1){
+    worker_num = 1;
+  }
+  EventLoop* loops = (EventLoop*)calloc(worker_num, sizeof(EventLoop));
+  long i = 0;
+  for(; i < worker_num; ++i){
+    EventLoop* loop = &loops[i];
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epoll_fd < 0){
+      perror("epoll_create");
+      return;
+    }
+    //水平触发，队列中还有连接时会一直通知；EPOLLEXCLUSIVE 避免每次都唤醒所有的工作线程
+    loop->queue_handle.type = kHandleConnQueue;
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = &loop->queue_handle;
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, g_conn_event_fd, &ev) < 0){
+      perror("epoll_ctl");
+      return;
+    }
+    //静态文件有变化时让缓存失效。inotify 不可用时 inotify_add_watch 会失败，文件就不放进缓存
+    loop->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(loop->inotify_fd < 0){
+      perror("inotify_init");
       continue;
     }
+    loop->inotify_handle.type = kHandleInotify;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &loop->inotify_handle;
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->inotify_fd, &ev) < 0){
+      perror("epoll_ctl");
+      return;
+    }
+  }
+  for(i = 0; i < worker_num; ++i){
     pthread_t tid;
-    pthread_create(&tid, NULL, ThreadEntry, (void*)&new_sock); 
+    pthread_create(&tid, NULL, EventLoopRun, &loops[i]);
     pthread_detach(tid);
   }
+  printf("Server Start! worker_num = %ld\n", worker_num);
+  AcceptLoop(listen_sock);
+}
+
+//解析 -c 参数：url_prefix=max_age_sec
+//把命令行参数解析成 [min_value, max_value] 之间的整数，不是整数或者超出范围时返回 -1
+int ParseIntOption(const char* arg, long min_value, long max_value, int* value){
+  char* end = NULL;
+  errno = 0;
+  long n = strtol(arg, &end, 10);
+  if(errno != 0 || end == arg || *end != '\0' || n < min_value || n > max_value){
+    return -1;
+  }
+  *value = (int)n;
+  return 0;
+}
+
+int AddCacheControlRule(char* arg){
+  char* eq = strrchr(arg, '=');
+  if(eq == NULL || eq == arg || g_cache_control_rule_num >= MAX_CACHE_CONTROL_RULES){
+    return -1;
+  }
+  int max_age = 0;
+  if(ParseIntOption(eq + 1, 0, 365 * 24 * 3600, &max_age) < 0){
+    return -1;
+  }
+  *eq = '\0';
+  CacheControlRule* rule = &g_cache_control_rules[g_cache_control_rule_num++];
+  rule->url_prefix = arg;
+  rule->max_age = max_age;
+  return 0;
+}
+
+void Usage(){
+  printf("Usage: ./http_server [-t idle_timeout_sec] [-n max_keepalive_requests] "
+         "[-w worker_num] [-q conn_queue_size] [-c url_prefix=max_age_sec]... "
+         "[IP] [port] [frontend_sock_path(可选)]\n");
 }
 
 int main(int argc, char* argv[]) {
-  if(argc != 3) {
-    printf("Usage: ./http_server.c [IP] [port]");
+  int opt = 0;
+  int ret = 0;
+  int idle_timeout_sec = g_idle_timeout_ms / 1000;
+  //超时时间不超过一天；工作线程数为 0 表示和 CPU 核数相同；
+  //连接队列的容量会向上取整到 2 的幂，最多 2^20
+  while((opt = getopt(argc, argv, "t:n:w:q:c:")) != -1){
+    switch(opt){
+      case 't':
+        ret = ParseIntOption(optarg, 1, 24 * 3600, &idle_timeout_sec);
+        break;
+      case 'n':
+        ret = ParseIntOption(optarg, 1, 1000000, &g_max_keepalive_requests);
+        break;
+      case 'w':
+        ret = ParseIntOption(optarg, 0, 1024, &g_worker_num);
+        break;
+      case 'q':
+        ret = ParseIntOption(optarg, 1, 1 << 20, &g_conn_queue_size);
+        break;
+      case 'c':
+        ret = AddCacheControlRule(optarg);
+        break;
+      default:
+        ret = -1;
+        break;
+    }
+    if(ret < 0){
+      Usage();
+      return 1;
+    }
+  }
+  g_idle_timeout_ms = idle_timeout_sec * 1000;
+  argc -= optind;
+  argv += optind;
+  if(argc != 2 && argc != 3) {
+    Usage();
     return 1;
   }
-  HttpServerStart(argv[1], atoi(argv[2]));
+  if(argc == 3){
+    g_frontend_sock_path = argv[2];
+  }
+  HttpServerStart(argv[0], atoi(argv[1]));
 
   return 0;
 }
-
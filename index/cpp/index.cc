@@ -1,6 +1,15 @@
 #include <fstream>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <queue>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/resource.h>
 #include <base/base.h>
 #include "index.h"
+#include "../../common/blocking_queue.hpp"
 
 // 此处词典的路径一会再具体考虑
 DEFINE_string(dict_path, "../../third_part/data/jieba_dict/jieba.dict.utf8", "字典路径");
@@ -8,60 +17,204 @@ DEFINE_string(hmm_path, "../../third_part/data/jieba_dict/hmm_model.utf8", "hmm
 DEFINE_string(user_dict_path, "../../third_part/data/jieba_dict/user.dict.utf8", "用户自定制词典路径");
 DEFINE_string(idf_path, "../../third_part/data/jieba_dict/idf.utf8", "idf 字典路径");
 DEFINE_string(stop_word_path, "../../third_part/data/jieba_dict/stop_words.utf8", "暂停词字典路径");
+DEFINE_string(posting_codec, "block", "索引文件中倒排拉链的压缩方式: raw / varint / block");
+DEFINE_bool(warm_index, true, "加载索引时预先把整个文件读入内存, "
+            "避免切换到新索引之后的缺页导致查询变慢");
+DEFINE_int32(top_posting_num, 200, "长拉链额外按照 weight 降序保存的元素个数, "
+             "单个词的查询直接从中取结果. 0 表示不保存");
 
 namespace doc_index {
 
 Index* Index::inst_ = NULL;
 
-Index::Index() : jieba_(fLS::FLAGS_dict_path,
+Index::Index() : load_count_(0),
+                 jieba_(fLS::FLAGS_dict_path,
                         fLS::FLAGS_hmm_path,
                         fLS::FLAGS_user_dict_path,
                         fLS::FLAGS_idf_path,
-                        fLS::FLAGS_stop_word_path) {
+                        fLS::FLAGS_stop_word_path),
+                 memory_budget_(0),
+                 inverted_bytes_(0),
+                 doc_count_(0) {
   CHECK(stop_word_dict_.Load(fLS::FLAGS_stop_word_path));
 }
 
 // 从 raw_input 文件中读数据, 在内存中构建成索引结构
-bool Index::Build(const std::string& input_path) {
+bool Index::Build(const std::string& input_path, int thread_num) {
   //std::cout << "Index building..." << std::endl; //TODO:临时日志
-  LOG(INFO) << "Index Build";
+  LOG(INFO) << "Index Build thread_num=" << thread_num;
   // 1. 按行读取文件内容, 针对读到的每一行数据进行处理
   std::ifstream file(input_path.c_str());
   CHECK(file.is_open()) << "input_path: " << input_path;
-  std::string line;
-  while (std::getline(file, line)) {
-    // 2. 把这一行数据制作成一个 DocInfo
-    //    此处获取到的 doc_info 是为了接下来制作倒排方便
-    const DocInfo* doc_info = BuildForward(line);
-    // 如果构建正排失败, 就立刻让进程终止
-    CHECK(doc_info != NULL);
-    // 3. 更新倒排信息
-    // 此函数的输出结果, 直接放到 Index::inverted_index_
-    BuildInverted(*doc_info);
+  // 2. 把每一行数据制作成一个 DocInfo, 并更新倒排信息
+  if (thread_num > 1) {
+    BuildParallel(file, thread_num);
+  } else {
+    BuildSerial(file);
   }
-  // 4. 处理完所有的文档之后, 针对所有的倒排拉链进行排序
-  //    key-value 中的value进行排序. 排序的依据按照权重
-  //    降序排序
-  SortInverted();
+  // 文档是按照 doc_id 的顺序合并的, 所以每条倒排拉链天然就是
+  // 按照 doc_id 升序排列的, 这正是索引文件要求的顺序, 不需要再排序
   file.close();
   LOG(INFO) << "Index Build Done!!!";
   return true;
 }
 
-const DocInfo* Index::BuildForward(const std::string& line) {
+// 获取当前进程实际占用的物理内存(字节)
+static size_t GetRssBytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0, rss_pages = 0;
+  statm >> total_pages >> rss_pages;
+  return rss_pages * sysconf(_SC_PAGESIZE);
+}
+
+// 获取进程运行以来占用物理内存的峰值(字节)
+static size_t GetMaxRssBytes() {
+  rusage usage;
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss * 1024;
+}
+
+static PostingCodec GetPostingCodec() {
+  PostingCodec codec = kBlockCodec;
+  CHECK(ParsePostingCodec(fLS::FLAGS_posting_codec, &codec))
+    << "unknown posting_codec: " << fLS::FLAGS_posting_codec;
+  return codec;
+}
+
+
+bool Index::BuildExternal(const std::string& input_path, const std::string& output_path,
+                          int thread_num, size_t memory_budget) {
+  LOG(INFO) << "Index BuildExternal thread_num=" << thread_num
+            << " memory_budget=" << memory_budget;
+  std::ifstream file(input_path.c_str());
+  CHECK(file.is_open()) << "input_path: " << input_path;
+  // 预算是针对整个进程的, 需要扣掉词典等已经占用的内存,
+  // 再给制作流水线中的文档以及每个线程的栈和内存分配器留出一部分余量,
+  // 剩下的才是倒排可用的部分
+  const size_t reserved = GetRssBytes() + (memory_budget / 8)
+                        + static_cast<size_t>(thread_num) * (2 << 20);
+  CHECK(memory_budget > reserved) << "memory_budget too small! rss=" << GetRssBytes();
+  memory_budget_ = memory_budget - reserved;
+  inverted_bytes_ = 0;
+  doc_count_ = 0;
+  output_path_ = output_path;
+  writer_.reset(new IndexWriter());
+  CHECK(writer_->Open(output_path, GetPostingCodec(),
+                      std::max(fLI::FLAGS_top_posting_num, 0)));
+  // 1. 制作正排, 同时在内存中累积倒排, 超过预算就写出一个有序段
+  if (thread_num > 1) {
+    BuildParallel(file, thread_num);
+  } else {
+    BuildSerial(file);
+  }
+  file.close();
+  FlushRun();
+  // 2. 多路归并所有的有序段, 追加到输出文件中
+  MergeRuns();
+  const size_t writer_bytes = writer_->MemoryBytes();
+  CHECK(writer_->Finish());
+  writer_.reset();
+  memory_budget_ = 0;
+  LOG(INFO) << "Index BuildExternal Done!!! doc_count=" << doc_count_
+            << " run_count=" << run_paths_.size() << " writer_bytes=" << writer_bytes
+            << " max_rss=" << GetMaxRssBytes();
+  run_paths_.clear();
+  return true;
+}
+
+void Index::BuildSerial(std::istream& file) {
+  uint64_t id = 0;
+  std::string line;
+  while (std::getline(file, line)) {
+    // 每篇文档都使用新的 BuildTask, word_cnt_map 的遍历顺序
+    // 才和并行制作时一致
+    BuildTask task;
+    task.id = id++;
+    task.line.swap(line);
+    ProcessDoc(&task);
+    MergeDoc(&task);
+  }
+}
+
+// 三个阶段通过有界队列串起来:
+//   读取线程 --input_queue--> thread_num 个分词线程 --output_queue--> 当前线程(合并倒排)
+// 分词线程处理完的顺序是不确定的, 合并时先放到 pending 中暂存,
+// 按照 id 从小到大依次合并, 保证 doc_id 和倒排拉链中的顺序都和单线程制作一致
+void Index::BuildParallel(std::istream& file, int thread_num) {
+  typedef std::unique_ptr<BuildTask> TaskPtr;
+  // 队列不需要太长, 能平滑各个线程之间的速度差异即可.
+  // 外存制作时队列中的文档也要计入内存预算
+  const size_t queue_size = 8 * thread_num;
+  common::BlockingQueue<TaskPtr> input_queue(queue_size);
+  common::BlockingQueue<TaskPtr> output_queue(queue_size);
+
+  std::thread reader([&file, &input_queue] {
+    uint64_t id = 0;
+    TaskPtr task(new BuildTask());
+    while (std::getline(file, task->line)) {
+      task->id = id++;
+      input_queue.Push(std::move(task));
+      task.reset(new BuildTask());
+    }
+    input_queue.Close();
+  });
+
+  // 最后一个退出的分词线程负责关闭 output_queue
+  std::atomic<int> running(thread_num);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < thread_num; ++i) {
+    workers.emplace_back([this, &input_queue, &output_queue, &running] {
+      TaskPtr task;
+      while (input_queue.Pop(&task)) {
+        ProcessDoc(task.get());
+        output_queue.Push(std::move(task));
+      }
+      if (--running == 0) {
+        output_queue.Close();
+      }
+    });
+  }
+
+  std::map<uint64_t, TaskPtr> pending;
+  uint64_t next_id = 0;
+  TaskPtr task;
+  while (output_queue.Pop(&task)) {
+    pending[task->id] = std::move(task);
+    for (auto it = pending.begin();
+         it != pending.end() && it->first == next_id;
+         it = pending.erase(it), ++next_id) {
+      MergeDoc(it->second.get());
+    }
+  }
+  CHECK(pending.empty()) << "pending.size()=" << pending.size();
+
+  reader.join();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void Index::ProcessDoc(BuildTask* task) const {
+  BuildForward(task);
+  CountWord(task);
+}
+
+void Index::BuildForward(BuildTask* task) const {
   // 1. 先对 line 进行字符串切分
   std::vector<std::string> tokens;
   // 当前的 Split 不会破坏原字符串
-  common::StringUtil::Split(line, &tokens, "\3");
+  common::StringUtil::Split(task->line, &tokens, "\3");
+  // 如果构建正排失败, 就立刻让进程终止
   if (tokens.size() != 3) {
     LOG(FATAL) << "line split not 3 tokens! tokens.size()="
                << tokens.size();
-    return NULL;
+    return;
   }
   // 2. 构造一个 DocInfo 结构, 把切分的结果赋值到 DocInfo
   //    除了分词结果之外都能进行赋值
-  DocInfo doc_info;
-  doc_info.set_id(forward_index_.size());
+  DocInfo& doc_info = task->doc_info;
+  doc_info.Clear();
+  doc_info.set_id(task->id);
   doc_info.set_title(tokens[1]);
   doc_info.set_content(tokens[2]);
   doc_info.set_jump_url(tokens[0]);
@@ -73,12 +226,9 @@ const DocInfo* Index::BuildForward(const std::string& line) {
   //    此处 doc_info 是输出参数, 用指针的方式传进去
   SplitTitle(tokens[1], &doc_info);
   SplitContent(tokens[2], &doc_info);
-  // 4. 把这个 DocInfo 插入到正排索引中
-  forward_index_.emplace_back(std::move(doc_info)); //TODO:以右值的方式插入临时对象更快一些
-  return &forward_index_.back();
 }
 
-void Index::SplitTitle(const std::string& title, DocInfo* doc_info) {
+void Index::SplitTitle(const std::string& title, DocInfo* doc_info) const {
   std::vector<cppjieba::Word> words;
   // 要调用 cppjieba 进行分词, 需要先创建一个 jieba 对象
   jieba_.CutForSearch(title, words);
@@ -105,7 +255,7 @@ void Index::SplitTitle(const std::string& title, DocInfo* doc_info) {
 }
 
 void Index::SplitContent(const std::string& content,
-    DocInfo* doc_info) {
+    DocInfo* doc_info) const {
   std::vector<cppjieba::Word> words;
   // 要调用 cppjieba 进行分词, 需要先创建一个 jieba 对象
   jieba_.CutForSearch(content, words);
@@ -131,8 +281,9 @@ void Index::SplitContent(const std::string& content,
   return;
 }
 
-void Index::BuildInverted(const DocInfo& doc_info) {
-  WordCntMap word_cnt_map;
+void Index::CountWord(BuildTask* task) const {
+  const DocInfo& doc_info = task->doc_info;
+  WordCntMap& word_cnt_map = task->word_cnt_map;
   // 1. 统计 title 中每个词出现的个数
   for (int i = 0; i < doc_info.title_token_size(); ++i) {
     //获取当前分词
@@ -164,129 +315,266 @@ void Index::BuildInverted(const DocInfo& doc_info) {
       word_cnt_map[word].first_pos = token.beg();
     }
   }
-  // 3. 根据个数的统计结果, 更新到倒排索引之中
-  //    遍历刚才的这个hash表, 拿着 key 去倒排索引中去查
-  //    如果倒排索引中不存在这个词, 就新增一项
-  //    如果倒排索引中已经存在这个词, 就根据当前构造好的
-  //    Weight结构添加到倒排索引中对应的倒排拉链中
+}
+
+void Index::MergeDoc(BuildTask* task) {
+  // Posting 中的 doc_id 只有 32 位
+  CHECK(task->id <= UINT32_MAX) << "too many docs! id=" << task->id;
+  if (memory_budget_ > 0) {
+    // 外存制作时正排直接写到输出文件中, 倒排太大时写出一个有序段
+    CHECK(task->id == doc_count_) << "id=" << task->id;
+    ++doc_count_;
+    CHECK(writer_->AddDoc(task->doc_info));
+    BuildInverted(task->doc_info, task->word_cnt_map);
+    if (inverted_bytes_ >= memory_budget_) {
+      FlushRun();
+    }
+    return;
+  }
+  // 把这个 DocInfo 插入到正排索引中, 此时 doc_id 必须和下标一致
+  CHECK(task->id == forward_index_.size()) << "id=" << task->id;
+  forward_index_.emplace_back(std::move(task->doc_info));
+  BuildInverted(forward_index_.back(), task->word_cnt_map);
+}
+
+void Index::BuildInverted(const DocInfo& doc_info, const WordCntMap& word_cnt_map) {
+  // 根据个数的统计结果, 更新到倒排索引之中
+  // 遍历统计出的hash表, 拿着 key 去倒排索引中去查
+  // 如果倒排索引中不存在这个词, 就新增一项
+  // 如果倒排索引中已经存在这个词, 就根据当前构造好的
+  // Posting结构添加到倒排索引中对应的倒排拉链中
   for (const auto& word_pair : word_cnt_map) {
-    Weight weight;
-    weight.set_doc_id(doc_info.id());
-    weight.set_weight(CalcWeight(word_pair.second.title_cnt, word_pair.second.content_cnt));
-    weight.set_first_pos(word_pair.second.first_pos);
+    Posting posting;
+    posting.doc_id = doc_info.id();
+    posting.weight = CalcWeight(word_pair.second.title_cnt, word_pair.second.content_cnt);
+    posting.first_pos = word_pair.second.first_pos;
     // 先获取到当前词对应的倒排拉链
     InvertedList& inverted_list = inverted_index_[word_pair.first];
-    inverted_list.emplace_back(std::move(weight)); //TODO：临时对象使用右值插入
+    // 顺便估算一下倒排占用的内存, 外存制作时据此决定何时写出有序段.
+    // 新增的词按照 key + hash 表节点来估算, 拉链按照 vector 实际的容量来估算
+    if (inverted_list.empty()) {
+      inverted_bytes_ += word_pair.first.capacity()
+                       + sizeof(InvertedIndex::value_type) + 2 * sizeof(void*);
+    }
+    size_t capacity = inverted_list.capacity();
+    inverted_list.push_back(posting);
+    inverted_bytes_ += (inverted_list.capacity() - capacity) * sizeof(Posting);
   }
   return;
 }
 
-int Index::CalcWeight(int title_cnt, int content_cnt) {
-  // 权重我们使用一种简单粗暴的方式来进行计算
-  return 10 * title_cnt + content_cnt;
+// 把内存中的倒排按照 key 排好序, 写成一个有序段文件, 然后清空内存中的倒排.
+// 有序段中每个 key 对应一条记录:
+//   uint32_t key_size | key | uint32_t posting_count | uint32_t data_size | data
+// 其中 data 是 varint 编码的拉链, 拉链保持插入的顺序(也就是 doc_id 升序)
+void Index::FlushRun() {
+  if (inverted_index_.empty()) {
+    return;
+  }
+  std::vector<InvertedIndex::value_type*> sorted;
+  sorted.reserve(inverted_index_.size());
+  for (auto& inverted_pair : inverted_index_) {
+    sorted.push_back(&inverted_pair);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](const InvertedIndex::value_type* p1, const InvertedIndex::value_type* p2) {
+              return p1->first < p2->first;
+            });
+  std::string run_path = output_path_ + ".run." + std::to_string(run_paths_.size());
+  std::ofstream run_file(run_path.c_str(), std::ios::binary | std::ios::trunc);
+  CHECK(run_file.is_open()) << "run_path: " << run_path;
+  std::string data;
+  for (const auto* inverted_pair : sorted) {
+    const std::string& key = inverted_pair->first;
+    const InvertedList& inverted_list = inverted_pair->second;
+    data.clear();
+    EncodePostings(kVarintCodec, inverted_list, &data);
+    uint32_t sizes[3] = {static_cast<uint32_t>(key.size()),
+                         static_cast<uint32_t>(inverted_list.size()),
+                         static_cast<uint32_t>(data.size())};
+    run_file.write(reinterpret_cast<const char*>(&sizes[0]), sizeof(uint32_t));
+    run_file.write(key.data(), key.size());
+    run_file.write(reinterpret_cast<const char*>(&sizes[1]), 2 * sizeof(uint32_t));
+    run_file.write(data.data(), data.size());
+  }
+  run_file.close();
+  CHECK(!run_file.fail()) << "write run failed! run_path: " << run_path;
+  LOG(INFO) << "FlushRun " << run_path << " key_count=" << sorted.size()
+            << " inverted_bytes=" << inverted_bytes_;
+  run_paths_.push_back(run_path);
+  // swap 一个空的 hash 表, 让桶数组的内存也释放掉
+  InvertedIndex().swap(inverted_index_);
+  inverted_bytes_ = 0;
 }
 
-void Index::SortInverted() {
-  // 把所有的倒排拉链都按照 weight 降序排序
-  for (auto& inverted_pair : inverted_index_) {
-    InvertedList& inverted_list = inverted_pair.second;
-    std::sort(inverted_list.begin(), inverted_list.end(), CmpWeight);
+// 有序段的顺序读取器, 每次读出一个 key 和编码后的拉链
+struct RunReader {
+  std::ifstream file;
+  std::string key;
+  std::string data;
+  PostingList postings;
+  size_t run_index;
+
+  bool Next() {
+    uint32_t key_size = 0;
+    if (!file.read(reinterpret_cast<char*>(&key_size), sizeof(key_size))) {
+      CHECK(file.eof() && file.gcount() == 0) << "run file corrupted! run_index=" << run_index;
+      return false;
+    }
+    key.resize(key_size);
+    uint32_t sizes[2] = {0, 0};
+    file.read(&key[0], key_size);
+    file.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+    data.resize(sizes[1]);
+    file.read(&data[0], sizes[1]);
+    CHECK(file.good()) << "run file corrupted! run_index=" << run_index;
+    postings.data = data.data();
+    postings.size = sizes[0];
+    postings.codec = kVarintCodec;
+    return true;
   }
+};
+
+// 对所有有序段做多路归并. 同一个 key 在各个段中的拉链按照段的顺序
+// 拼接起来, 就恢复出了全内存制作时的拉链(doc_id 升序), 直接写出.
+// 归并时内存中只有每个段当前的一条记录和正在合并的一条拉链
+void Index::MergeRuns() {
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (size_t i = 0; i < run_paths_.size(); ++i) {
+    std::unique_ptr<RunReader> reader(new RunReader());
+    reader->file.open(run_paths_[i].c_str(), std::ios::binary);
+    CHECK(reader->file.is_open()) << "run_path: " << run_paths_[i];
+    reader->run_index = i;
+    readers.push_back(std::move(reader));
+  }
+  // 小堆, 先按 key 再按段的顺序
+  auto cmp = [](const RunReader* r1, const RunReader* r2) {
+    if (r1->key != r2->key) {
+      return r1->key > r2->key;
+    }
+    return r1->run_index > r2->run_index;
+  };
+  std::priority_queue<RunReader*, std::vector<RunReader*>, decltype(cmp)> heap(cmp);
+  for (auto& reader : readers) {
+    if (reader->Next()) {
+      heap.push(reader.get());
+    }
+  }
+  size_t key_count = 0;
+  std::string key;
+  InvertedList merged;
+  while (!heap.empty()) {
+    key = heap.top()->key;
+    merged.clear();
+    while (!heap.empty() && heap.top()->key == key) {
+      RunReader* reader = heap.top();
+      heap.pop();
+      PostingCursor::DecodeAll(reader->postings, &merged);
+      if (reader->Next()) {
+        heap.push(reader);
+      }
+    }
+    CHECK(writer_->AddTerm(key, merged));
+    ++key_count;
+  }
+  readers.clear();
+  for (const auto& run_path : run_paths_) {
+    std::remove(run_path.c_str());
+  }
+  LOG(INFO) << "MergeRuns Done! key_count=" << key_count;
 }
 
-bool Index::CmpWeight(const Weight& w1, const Weight& w2) {
-  return w1.weight() > w2.weight();
+int Index::CalcWeight(int title_cnt, int content_cnt) const {
+  // 权重我们使用一种简单粗暴的方式来进行计算
+  return 10 * title_cnt + content_cnt;
 }
 
 // 把内存中的索引数据保存到磁盘上
 bool Index::Save(const std::string& output_path) {
   //std::cout << "Index Saved..." << std::endl; //TODO:临时日志
   LOG(INFO) << "Index Save";
-  // 1. 把内存中的索引结构序列化成字符串
-  std::string proto_data;
-  CHECK(ConvertToProto(&proto_data));
-  // 2. 把序列化得到的字符串写到文件中
-  CHECK(common::FileUtil::Write(output_path, proto_data));
-  LOG(INFO) << "Index Save Done";
-  return true;
-}
-
-bool Index::ConvertToProto(std::string* proto_data) {
-  doc_index_proto::Index index;
-  // 需要把内存中的数据设置到 index 中
-  // 1. 设置正排
+  IndexWriter writer;
+  CHECK(writer.Open(output_path, GetPostingCodec(),
+                    std::max(fLI::FLAGS_top_posting_num, 0)));
+  // 1. 写正排, 按照 doc_id 的顺序
   for (const auto& doc_info : forward_index_) {
-    auto* proto_doc_info = index.add_forward_index();
-    *proto_doc_info = doc_info;
+    CHECK(writer.AddDoc(doc_info));
   }
-  // 2. 设置倒排
+  // 2. 写倒排, 索引文件中要求按照 key 升序
+  std::vector<const InvertedIndex::value_type*> sorted;
+  sorted.reserve(inverted_index_.size());
   for (const auto& inverted_pair : inverted_index_) {
-    auto* kwd_info = index.add_inverted_index();
-    kwd_info->set_key(inverted_pair.first);
-    for (const auto& weight : inverted_pair.second) {
-      auto* proto_weight = kwd_info->add_doc_list();
-      *proto_weight = weight;
-    }
+    sorted.push_back(&inverted_pair);
   }
-  index.SerializeToString(proto_data);
+  std::sort(sorted.begin(), sorted.end(),
+            [](const InvertedIndex::value_type* p1, const InvertedIndex::value_type* p2) {
+              return p1->first < p2->first;
+            });
+  for (const auto* inverted_pair : sorted) {
+    CHECK(writer.AddTerm(inverted_pair->first, inverted_pair->second));
+  }
+  CHECK(writer.Finish());
+  LOG(INFO) << "Index Save Done";
   return true;
 }
 
-// 把磁盘上的文件加载到内存的索引结构中
+// 把磁盘上的索引文件映射到内存中
 bool Index::Load(const std::string& index_path) {
   //std::cout << "Index loading..." << std::endl; //TODO:临时日志
-  LOG(INFO) << "Index Load";
-  // 1. 从磁盘上把索引文件读到内存中
-  std::string proto_data;
-  CHECK(common::FileUtil::Read(index_path, &proto_data));
-  // 2. 进行反序列化, 转成内存的索引结构
-  CHECK(ConvertFromProto(proto_data));
-  LOG(INFO) << "Index Load Done";
-  return true;
-}
-
-bool Index::ConvertFromProto(const std::string& proto_data) {
-  // 1. 对索引文件内容进行反序列化
-  doc_index_proto::Index index;
-  index.ParseFromString(proto_data);
-  // 2. 把正排索引数据放到内存中
-  for (int i = 0; i < index.forward_index_size(); ++i) {
-    const auto& doc_info = index.forward_index(i);
-    forward_index_.push_back(doc_info); //TODO:考虑使用右值插入提高效率
+  std::lock_guard<std::mutex> lock(load_mutex_);
+  LOG(INFO) << "Index Load index_path=" << index_path;
+  std::shared_ptr<IndexSnapshot> snapshot(new IndexSnapshot(load_count_ + 1));
+  if (!snapshot->mutable_reader()->Open(index_path)) {
+    LOG(ERROR) << "Index Load failed! index_path=" << index_path;
+    return false;
   }
-  // 3. 把倒排索引数据放到内存中
-  for (int i = 0; i < index.inverted_index_size(); ++i) {
-    const auto& kwd_info = index.inverted_index(i);
-    InvertedList& inverted_list = inverted_index_[kwd_info.key()];
-    for (int j = 0; j < kwd_info.doc_list_size(); ++j) {
-      const auto& weight = kwd_info.doc_list(j);
-      inverted_list.push_back(weight); //TODO:考虑使用右值插入提高效率
-    }
+  if (fLB::FLAGS_warm_index) {
+    snapshot->reader().Warm();
   }
+  ++load_count_;
+  // 新版本准备好之后再原子地发布. 旧版本在最后一个查询释放引用时回收
+  std::atomic_store(&snapshot_, IndexSnapshotPtr(snapshot));
+  LOG(INFO) << "Index Load Done! generation=" << snapshot->generation()
+            << " doc_count=" << snapshot->reader().doc_count()
+            << " term_count=" << snapshot->reader().term_count();
   return true;
 }
 
-// 调试用的接口, 把内存中的索引数据按照一定的格式打印到
+IndexSnapshotPtr Index::GetSnapshot() const {
+  return std::atomic_load(&snapshot_);
+}
+
+// 调试用的接口, 把加载的索引数据按照一定的格式打印到
 // 文件中
 bool Index::Dump(const std::string& forward_dump_path, const std::string& inverted_dump_path) {
   //std::cout << "Index dumping..." << std::endl; //TODO：临时日志
   LOG(INFO) << "Index Dump";
+  IndexSnapshotPtr snapshot = GetSnapshot();
+  CHECK(snapshot != NULL);
+  const IndexReader& reader = snapshot->reader();
   // 1. 处理正排
   std::ofstream forward_dump_file(forward_dump_path.c_str());
   CHECK(forward_dump_file.is_open());
-  for (size_t i = 0; i < forward_index_.size(); ++i) {
-    const DocInfo& doc_info = forward_index_[i];
-    forward_dump_file << doc_info.Utf8DebugString()
+  for (uint64_t i = 0; i < reader.doc_count(); ++i) {
+    DocView doc_info;
+    CHECK(reader.GetDoc(i, &doc_info));
+    forward_dump_file << "id: " << i << "\n"
+                      << "title: \"" << doc_info.title() << "\"\n"
+                      << "content: \"" << doc_info.content() << "\"\n"
+                      << "show_url: \"" << doc_info.show_url() << "\"\n"
+                      << "jump_url: \"" << doc_info.jump_url() << "\"\n"
                       << "=================";
   }
   forward_dump_file.close();
   // 2. 处理倒排
   std::ofstream inverted_dump_file(inverted_dump_path.c_str());
   CHECK(inverted_dump_file.is_open());
-  for (const auto& inverted_pair : inverted_index_) {
-    inverted_dump_file << inverted_pair.first << "\n";
-    for (const auto& weight : inverted_pair.second) {
-      inverted_dump_file << weight.Utf8DebugString();
+  for (uint64_t i = 0; i < reader.term_count(); ++i) {
+    inverted_dump_file << reader.GetTermKey(i) << "\n";
+    for (PostingCursor cursor(reader.GetTermPostings(i)); cursor.Valid(); cursor.Next()) {
+      inverted_dump_file << "doc_id: " << cursor.doc_id() << "\n"
+                         << "weight: " << cursor.weight() << "\n"
+                         << "first_pos: " << cursor.first_pos() << "\n";
     }
     inverted_dump_file << "==================";
   }
@@ -295,23 +583,6 @@ bool Index::Dump(const std::string& forward_dump_path, const std::string& invert
   return true;
 }
 
-// 根据 doc_id 获取到 文档详细信息
-const DocInfo* Index::GetDocInfo(uint64_t doc_id) const {
-  if (doc_id >= forward_index_.size()) {
-    return NULL;
-  }
-  return &forward_index_[doc_id];
-}
-
-// 根据关键词获取到 倒排拉链(包含了一组doc_id)
-const InvertedList* Index::GetInvertedList( const std::string& key) const {
-  auto it = inverted_index_.find(key);
-  if (it == inverted_index_.end()) {
-    return NULL;
-  }
-  return &(it->second);
-}
-
 // 需要把所有的暂停词从分词结果中过滤掉
 void Index::CutWordWithoutStopWord(const std::string& query, std::vector<std::string>* words) {
   words->clear();
@@ -323,7 +594,7 @@ void Index::CutWordWithoutStopWord(const std::string& query, std::vector<std::st
     if (stop_word_dict_.Find(token)) {
       continue;
     }
-    words->push_back(token); //TODO：考虑使用右值插入提高效率
+    words->push_back(std::move(token));
   }
 }
 }  // end doc_index
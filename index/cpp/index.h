@@ -1,19 +1,23 @@
 #pragma once
 
 #include <vector>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 #include <cppjieba/Jieba.hpp>
 #include <utility>
 #include "index.pb.h"
+#include "index_file.h"
 #include "../../common/util.hpp"
 
 namespace doc_index {
 
 // 定义一些类型
 typedef doc_index_proto::DocInfo DocInfo;
-typedef doc_index_proto::Weight Weight;
 typedef std::vector<DocInfo> ForwardIndex;
-typedef std::vector<Weight> InvertedList;  // 倒排拉链
+// 倒排拉链. 使用 12 字节的 Posting 结构连续存放, 而不是 protobuf 的 Weight
+// (每个 Weight 还带着虚表指针, _has_bits_ 等字段, 要大好几倍)
+typedef std::vector<Posting> InvertedList;
 typedef std::unordered_map<std::string, InvertedList> InvertedIndex;
 
 struct WordCnt {
@@ -28,15 +32,55 @@ struct WordCnt {
 
 typedef std::unordered_map<std::string, WordCnt> WordCntMap;
 
+// 制作索引时一篇文档的处理单元.
+// 读取线程填好 id 和 line, 分词线程填好 doc_info 和 word_cnt_map,
+// 最后由倒排线程按照 id 的顺序合并到索引结构中
+struct BuildTask {
+  uint64_t id;
+  std::string line;
+  DocInfo doc_info;
+  WordCntMap word_cnt_map;
+};
+
+// 加载好的一个版本的索引文件.
+// 查询开始时通过 Index::GetSnapshot 取得当前版本, 整个查询过程都使用这个版本.
+// 重新加载索引时, 新版本加载完成之后原子地替换掉当前版本; 正在进行的查询
+// 仍然持有旧版本的引用, 最后一个引用释放时旧版本才会被回收(munmap)
+class IndexSnapshot {
+public:
+  explicit IndexSnapshot(uint64_t generation) : generation_(generation) {}
+
+  // 每次 Load 都会得到一个新的版本号, 用于判断依赖索引内容的缓存是否过期
+  uint64_t generation() const { return generation_; }
+  const IndexReader& reader() const { return reader_; }
+  IndexReader* mutable_reader() { return &reader_; }
+
+  // 根据 doc_id 获取到 文档详细信息
+  bool GetDocInfo(uint64_t doc_id, DocView* doc_info) const {
+    return reader_.GetDoc(doc_id, doc_info);
+  }
+
+  // 根据关键词获取到 倒排拉链(包含了一组doc_id)
+  // key 使用 string_ref, 调用方不需要为了查找专门构造 std::string
+  bool GetInvertedList(boost::string_ref key, PostingList* inverted_list) const {
+    return reader_.GetPostingList(key, inverted_list);
+  }
+
+private:
+  IndexReader reader_;
+  uint64_t generation_;
+};
+
+typedef std::shared_ptr<const IndexSnapshot> IndexSnapshotPtr;
+
 // 索引模块核心类. 和索引相关的全部操作都包含在这个类中
 // a) 构建, raw_input 中的内容进行解析在内存中构造
 //    出索引结构(hash)
-// b) 保存, 把内存中的索引结构进行序列化, 存到文件中
-//    (序列化就依赖了刚才的 index.proto) 制作索引的可执行
-//    程序来调用保存
-// c) 加载, 把磁盘上的索引文件读取出来, 反序列化, 生成
-//    内存中的索引结构拱搜索服务器使用
-// d) 反解, 内存中的索引结果按照一定的格式打印出来, 方便
+// b) 保存, 把内存中的索引结构写成索引文件(格式见 index_file.h)
+//    制作索引的可执行程序来调用保存
+// c) 加载, 把磁盘上的索引文件 mmap 到内存中, 直接在映射的
+//    内存上查询, 供搜索服务器使用. 可以在服务过程中重新加载
+// d) 反解, 加载的索引结果按照一定的格式打印出来, 方便
 //    测试
 // e) 查正排, 给定文档id, 获取到文档的详细信息
 // f) 查倒排, 给定关键词, 获取到和关键词相关的文档列表
@@ -52,45 +96,73 @@ public:
   }
 
   // 从 raw_input 文件中读数据, 在内存中构建成索引结构
-  bool Build(const std::string& input_path);
+  // thread_num > 1 时, 读取/分词/合并倒排三个阶段并行执行,
+  // 分词阶段使用 thread_num 个线程. 结果和单线程制作完全一致
+  bool Build(const std::string& input_path, int thread_num = 1);
+
+  // 外存方式制作索引, 适用于内存放不下整个索引的情况. 直接生成索引文件,
+  // 不需要再调用 Save. 正排在制作过程中直接写到输出文件中;
+  // 内存中的倒排超过 memory_budget 字节时, 排好序作为一个有序段写到磁盘,
+  // 最后对所有有序段做多路归并, 追加到输出文件中.
+  // memory_budget 限制的是整个进程中分词和倒排占用的内存, 输出文件的文档偏移和词典
+  // (见 IndexWriter) 和文档数、词数成正比, 不在预算之内, 词数很多时峰值会超过预算
+  bool BuildExternal(const std::string& input_path, const std::string& output_path,
+                     int thread_num, size_t memory_budget);
 
   // 把内存中的索引数据保存到磁盘上
   bool Save(const std::string& output_path);
 
-  // 把磁盘上的文件加载到内存的索引结构中
+  // 把磁盘上的索引文件映射到内存中, 然后替换掉当前版本.
+  // 可以在查询进行的同时调用, 加载失败时当前版本保持不变
   bool Load(const std::string& index_path);
 
-  // 调试用的接口, 把内存中的索引数据按照一定的格式打印到文件中
-  bool Dump(const std::string& forward_dump_path, const std::string& inverted_dump_path);
-
-  // 根据 doc_id 获取到 文档详细信息
-  const DocInfo* GetDocInfo(uint64_t doc_id) const;
+  // 取得当前版本的索引, 需要先 Load. 可以被多个线程同时调用
+  IndexSnapshotPtr GetSnapshot() const;
 
-  // 根据关键词获取到 倒排拉链(包含了一组doc_id)
-  const InvertedList* GetInvertedList(const std::string& key) const;
+  // 调试用的接口, 把加载的索引数据按照一定的格式打印到文件中
+  bool Dump(const std::string& forward_dump_path, const std::string& inverted_dump_path);
 
   // 此处为了方便 服务器 进行分词, 再提供一个函数
   void CutWordWithoutStopWord(const std::string& query, std::vector<std::string>* words);
   
 private:
+  // 制作索引时使用的内存中的索引结构
   ForwardIndex forward_index_;
   InvertedIndex inverted_index_;
+  // 当前版本的索引文件, 只通过 std::atomic_load/atomic_store 访问
+  IndexSnapshotPtr snapshot_;
+  // 保证同一时间只有一个 Load 在执行
+  std::mutex load_mutex_;
+  uint64_t load_count_;
   cppjieba::Jieba jieba_;
   common::DictUtil stop_word_dict_;
 
   static Index* inst_;
 
+  // 以下成员只在外存制作索引时使用
+  size_t memory_budget_;      // 内存中倒排的上限, 为 0 表示不限制(全内存制作)
+  size_t inverted_bytes_;     // 内存中倒排大约占用的字节数
+  uint64_t doc_count_;        // 已经写到输出文件中的文档数
+  std::unique_ptr<IndexWriter> writer_;
+  std::string output_path_;
+  std::vector<std::string> run_paths_;  // 已经写到磁盘上的有序段
+
   // 以下函数为内部使用的函数
-  const DocInfo* BuildForward(const std::string& line);
-  void BuildInverted(const DocInfo& doc_info);
-  void SortInverted();
-  void SplitTitle(const std::string& title, DocInfo* doc_info);
+  void BuildSerial(std::istream& file);
+  void BuildParallel(std::istream& file, int thread_num);
+  // 分词线程执行的部分, 只读访问 Index 的成员, 可以并发调用
+  void ProcessDoc(BuildTask* task) const;
+  void BuildForward(BuildTask* task) const;
+  void CountWord(BuildTask* task) const;
+  // 倒排线程执行的部分, 必须按照 id 的顺序调用
+  void MergeDoc(BuildTask* task);
+  void BuildInverted(const DocInfo& doc_info, const WordCntMap& word_cnt_map);
+  void FlushRun();
+  void MergeRuns();
+  void SplitTitle(const std::string& title, DocInfo* doc_info) const;
   void SplitContent(const std::string& content,
-                    DocInfo* doc_info);
-  int CalcWeight(int title_cnt, int content_cnt);
-  static bool CmpWeight(const Weight& w1, const Weight& w2);
-  bool ConvertToProto(std::string* proto_data);
-  bool ConvertFromProto(const std::string& proto_data);
+                    DocInfo* doc_info) const;
+  int CalcWeight(int title_cnt, int content_cnt) const;
 };
 
 }  // end doc_index
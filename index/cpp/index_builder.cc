@@ -5,11 +5,23 @@ DEFINE_string(input_path, "../data/tmp/raw_input",
               "raw_input 文件路径");
 DEFINE_string(output_path, "../data/output/index_file",
               "索引文件输出路径");
+DEFINE_int32(build_threads, 1,
+             "制作索引时的分词线程数, 大于 1 时启用流水线并行制作");
+DEFINE_int32(build_memory_mb, 0,
+             "制作索引时进程的内存预算(MB), 大于 0 时使用外存方式制作索引. "
+             "不包括和文档数、词数成正比的文档偏移和词典");
 
 int main(int argc, char* argv[]) {
   base::InitApp(argc, argv);
   doc_index::Index* index = doc_index::Index::Instance();
-  CHECK(index->Build(fLS::FLAGS_input_path));
+  if (fLI::FLAGS_build_memory_mb > 0) {
+    // 外存制作直接生成索引文件
+    CHECK(index->BuildExternal(fLS::FLAGS_input_path, fLS::FLAGS_output_path,
+                               fLI::FLAGS_build_threads,
+                               static_cast<size_t>(fLI::FLAGS_build_memory_mb) << 20));
+    return 0;
+  }
+  CHECK(index->Build(fLS::FLAGS_input_path, fLI::FLAGS_build_threads));
   CHECK(index->Save(fLS::FLAGS_output_path));
   return 0;
 }
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <base/base.h>
+#include "index_file.h"
+
+namespace doc_index {
+
+// 索引文件中的 hash 表在制作时生成, 在搜索服务器中使用,
+// 所以不能用 std::hash 这种和实现相关的函数. 此处使用 FNV-1a,
+// 最后再把高位混合到低位, 让按照低位取模的槽位分布更均匀
+static uint64_t HashTerm(boost::string_ref key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : key) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+IndexWriter::IndexWriter() : offset_(0), docs_finished_(false), top_num_(0) {
+  memset(&header_, 0, sizeof(header_));
+}
+
+bool IndexWriter::Open(const std::string& path, PostingCodec codec, uint32_t top_num) {
+  header_.posting_codec = codec;
+  top_num_ = top_num;
+  path_ = path;
+  const std::string tmp_path = path + ".tmp";
+  file_.open(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file_.is_open()) {
+    LOG(ERROR) << "IndexWriter open failed! path=" << tmp_path;
+    return false;
+  }
+  // 先占住文件头的位置, Finish 的时候再回来写真正的内容
+  Write(&header_, sizeof(header_));
+  Align();
+  header_.doc_data.offset = offset_;
+  return true;
+}
+
+void IndexWriter::Write(const void* data, size_t size) {
+  file_.write(static_cast<const char*>(data), size);
+  offset_ += size;
+}
+
+void IndexWriter::Align() {
+  static const char padding[8] = {0};
+  if (offset_ % 8 != 0) {
+    Write(padding, 8 - offset_ % 8);
+  }
+}
+
+bool IndexWriter::AddDoc(const doc_index_proto::DocInfo& doc_info) {
+  if (docs_finished_ || doc_info.id() != doc_offsets_.size()) {
+    LOG(ERROR) << "AddDoc out of order! id=" << doc_info.id();
+    return false;
+  }
+  doc_offsets_.push_back(offset_ - header_.doc_data.offset);
+  DocRecord record;
+  record.title_size = doc_info.title().size();
+  record.content_size = doc_info.content().size();
+  record.show_url_size = doc_info.show_url().size();
+  record.jump_url_size = doc_info.jump_url().size();
+  Write(&record, sizeof(record));
+  Write(doc_info.title().data(), record.title_size);
+  Write(doc_info.content().data(), record.content_size);
+  Write(doc_info.show_url().data(), record.show_url_size);
+  Write(doc_info.jump_url().data(), record.jump_url_size);
+  // 保证下一个 DocRecord 也是对齐的
+  Align();
+  return true;
+}
+
+// 文档写完之后, 写出 doc_offsets, 并开始写倒排拉链
+void IndexWriter::FinishDocs() {
+  if (docs_finished_) {
+    return;
+  }
+  docs_finished_ = true;
+  header_.doc_count = doc_offsets_.size();
+  header_.doc_data.size = offset_ - header_.doc_data.offset;
+  // 多存一个结尾位置, 方便校验最后一个文档的长度
+  doc_offsets_.push_back(header_.doc_data.size);
+  header_.doc_offsets.offset = offset_;
+  header_.doc_offsets.size = doc_offsets_.size() * sizeof(uint64_t);
+  Write(doc_offsets_.data(), header_.doc_offsets.size);
+  std::vector<uint64_t>().swap(doc_offsets_);
+  Align();
+  header_.postings.offset = offset_;
+}
+
+bool IndexWriter::AddTerm(const std::string& key, const std::vector<Posting>& postings) {
+  FinishDocs();
+  if (term_entries_.size() >= UINT32_MAX) {
+    LOG(ERROR) << "too many terms!";
+    return false;
+  }
+  if (!term_entries_.empty() && key <= last_key_) {
+    LOG(ERROR) << "AddTerm out of order! key=" << key << " last_key=" << last_key_;
+    return false;
+  }
+  last_key_ = key;
+  // 每条拉链的开头都是 BlockMeta 数组, 对齐之后直接访问
+  Align();
+  TermEntry entry;
+  entry.key_offset = term_keys_.size();
+  entry.key_size = key.size();
+  entry.posting_offset = offset_ - header_.postings.offset;
+  entry.posting_count = postings.size();
+  entry.max_weight = MaxWeight(postings);
+  posting_buf_.clear();
+  EncodePostings(static_cast<PostingCodec>(header_.posting_codec), postings, &posting_buf_);
+  Write(posting_buf_.data(), posting_buf_.size());
+  // 短拉链整条解码也很快, 不需要再多存一份
+  top_buf_.clear();
+  if (postings.size() > kPostingBlockSize) {
+    TopPostings(postings, top_num_, &top_buf_);
+  }
+  Align();
+  entry.top_offset = offset_ - header_.postings.offset;
+  entry.top_count = top_buf_.size();
+  Write(top_buf_.data(), top_buf_.size() * sizeof(Posting));
+  term_entries_.push_back(entry);
+  term_keys_.append(key);
+  return true;
+}
+
+bool IndexWriter::Finish() {
+  FinishDocs();
+  header_.postings.size = offset_ - header_.postings.offset;
+  Align();
+  header_.term_count = term_entries_.size();
+  header_.term_entries.offset = offset_;
+  header_.term_entries.size = term_entries_.size() * sizeof(TermEntry);
+  Write(term_entries_.data(), header_.term_entries.size);
+  header_.term_keys.offset = offset_;
+  header_.term_keys.size = term_keys_.size();
+  Write(term_keys_.data(), term_keys_.size());
+  Align();
+  WriteTermHash();
+  header_.file_size = offset_;
+  memcpy(header_.magic, kIndexMagic, sizeof(header_.magic));
+  header_.version = kIndexVersion;
+  header_.header_size = sizeof(header_);
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  file_.close();
+  if (file_.fail()) {
+    LOG(ERROR) << "IndexWriter write failed!";
+    return false;
+  }
+  if (rename((path_ + ".tmp").c_str(), path_.c_str()) < 0) {
+    PLOG(ERROR) << "IndexWriter rename failed! path=" << path_;
+    return false;
+  }
+  return true;
+}
+
+void IndexWriter::WriteTermHash() {
+  uint64_t hash_size = 2;
+  while (hash_size < 2 * term_entries_.size()) {
+    hash_size *= 2;
+  }
+  const uint64_t mask = hash_size - 1;
+  std::vector<TermSlot> slots(hash_size);
+  memset(slots.data(), 0, hash_size * sizeof(TermSlot));
+  for (size_t i = 0; i < term_entries_.size(); ++i) {
+    const TermEntry& entry = term_entries_[i];
+    uint64_t hash = HashTerm(boost::string_ref(term_keys_.data() + entry.key_offset,
+                                               entry.key_size));
+    uint64_t pos = hash & mask;
+    while (slots[pos].term != 0) {
+      pos = (pos + 1) & mask;
+    }
+    slots[pos].term = i + 1;
+    slots[pos].tag = hash >> 32;
+  }
+  header_.term_hash.offset = offset_;
+  header_.term_hash.size = hash_size * sizeof(TermSlot);
+  Write(slots.data(), header_.term_hash.size);
+}
+
+IndexReader::IndexReader()
+  : base_(NULL), size_(0), header_(NULL), doc_data_(NULL),
+    doc_offsets_(NULL), postings_(NULL), term_entries_(NULL), term_keys_(NULL),
+    term_hash_(NULL), hash_mask_(0) {}
+
+IndexReader::~IndexReader() {
+  if (base_ != NULL) {
+    munmap(const_cast<char*>(base_), size_);
+  }
+}
+
+void IndexReader::Warm() const {
+  madvise(const_cast<char*>(base_), size_, MADV_WILLNEED);
+  // madvise 只是异步预读, 再逐页访问一遍, 确保页表也建立好
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  volatile char sum = 0;
+  for (size_t i = 0; i < size_; i += page_size) {
+    sum ^= base_[i];
+  }
+  (void) sum;
+}
+
+bool IndexReader::CheckSection(const Section& section) const {
+  return section.offset <= size_ && section.size <= size_ - section.offset;
+}
+
+bool IndexReader::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    PLOG(ERROR) << "open index failed! path=" << path;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+    LOG(ERROR) << "index file too small! path=" << path;
+    close(fd);
+    return false;
+  }
+  // MAP_SHARED + 只读, 多个进程加载同一个索引文件时共享物理内存.
+  // 此处不预读, 用到哪一页再由缺页中断加载哪一页
+  void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    PLOG(ERROR) << "mmap index failed! path=" << path;
+    return false;
+  }
+  base_ = static_cast<const char*>(addr);
+  size_ = st.st_size;
+  header_ = reinterpret_cast<const FileHeader*>(base_);
+  if (memcmp(header_->magic, kIndexMagic, sizeof(kIndexMagic)) != 0
+      || header_->version != kIndexVersion
+      || header_->header_size != sizeof(FileHeader)
+      || header_->file_size != size_
+      || header_->posting_codec > kBlockCodec) {
+    LOG(ERROR) << "bad index file header! path=" << path;
+    return false;
+  }
+  if (!CheckSection(header_->doc_data) || !CheckSection(header_->doc_offsets)
+      || !CheckSection(header_->postings) || !CheckSection(header_->term_entries)
+      || !CheckSection(header_->term_keys) || !CheckSection(header_->term_hash)
+      || header_->doc_offsets.size != (header_->doc_count + 1) * sizeof(uint64_t)
+      || header_->term_entries.size != header_->term_count * sizeof(TermEntry)) {
+    LOG(ERROR) << "bad index file section! path=" << path;
+    return false;
+  }
+  doc_data_ = base_ + header_->doc_data.offset;
+  doc_offsets_ = reinterpret_cast<const uint64_t*>(base_ + header_->doc_offsets.offset);
+  postings_ = base_ + header_->postings.offset;
+  term_entries_ = reinterpret_cast<const TermEntry*>(base_ + header_->term_entries.offset);
+  term_keys_ = base_ + header_->term_keys.offset;
+  term_hash_ = reinterpret_cast<const TermSlot*>(base_ + header_->term_hash.offset);
+  const uint64_t hash_size = header_->term_hash.size / sizeof(TermSlot);
+  if (hash_size <= header_->term_count || (hash_size & (hash_size - 1)) != 0) {
+    LOG(ERROR) << "bad index file term_hash! path=" << path;
+    return false;
+  }
+  hash_mask_ = hash_size - 1;
+  return true;
+}
+
+bool IndexReader::GetDoc(uint64_t doc_id, DocView* doc) const {
+  if (doc_id >= header_->doc_count) {
+    return false;
+  }
+  *doc = DocView(reinterpret_cast<const DocRecord*>(doc_data_ + doc_offsets_[doc_id]));
+  return true;
+}
+
+boost::string_ref IndexReader::GetTermKey(uint64_t term_index) const {
+  const TermEntry& entry = term_entries_[term_index];
+  return boost::string_ref(term_keys_ + entry.key_offset, entry.key_size);
+}
+
+PostingList IndexReader::GetTermPostings(uint64_t term_index) const {
+  const TermEntry& entry = term_entries_[term_index];
+  PostingList list;
+  list.data = postings_ + entry.posting_offset;
+  list.size = entry.posting_count;
+  list.codec = static_cast<PostingCodec>(header_->posting_codec);
+  list.max_weight = entry.max_weight;
+  list.top = reinterpret_cast<const Posting*>(postings_ + entry.top_offset);
+  list.top_size = entry.top_count;
+  return list;
+}
+
+bool IndexReader::FindTerm(boost::string_ref key, uint64_t* term_index) const {
+  const uint64_t hash = HashTerm(key);
+  const uint32_t tag = hash >> 32;
+  for (uint64_t pos = hash & hash_mask_; ; pos = (pos + 1) & hash_mask_) {
+    const TermSlot& slot = term_hash_[pos];
+    if (slot.term == 0) {
+      return false;
+    }
+    if (slot.tag == tag && GetTermKey(slot.term - 1) == key) {
+      *term_index = slot.term - 1;
+      return true;
+    }
+  }
+}
+
+bool IndexReader::GetPostingList(boost::string_ref key, PostingList* list) const {
+  uint64_t term_index = 0;
+  if (!FindTerm(key, &term_index)) {
+    return false;
+  }
+  *list = GetTermPostings(term_index);
+  return true;
+}
+
+}  // end doc_index
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/utility/string_ref.hpp>
+#include "index.pb.h"
+#include "posting_codec.h"
+
+namespace doc_index {
+
+// 索引文件的格式. 搜索服务器直接 mmap 整个文件, 在映射的内存上查询,
+// 不需要反序列化, 也不需要拷贝. 多个进程映射同一个文件时共享同一份页缓存.
+// 所有整数都是本机字节序(小端), 每个段的起始位置都按 8 字节对齐.
+//
+// +--------------+
+// | FileHeader   |
+// +--------------+
+// | doc_data     |  按 doc_id 顺序存放的文档, 每个文档是 DocRecord + 四个字段的内容
+// | doc_offsets  |  uint64_t[doc_count + 1], 每个文档在 doc_data 中的起始位置
+// | postings     |  所有倒排拉链, 按照 doc_id 升序排列, 编码方式见 posting_codec.h.
+// |              |  长拉链后面还跟着 weight 最大的若干个 Posting, 按照 weight 降序排列
+// | term_entries |  TermEntry[term_count], 按照 key 的字节序升序排列
+// | term_keys    |  所有 key 的内容拼接在一起
+// | term_hash    |  TermSlot[2^n], 开放寻址(线性探测)的 hash 表, 按照 key 查找 TermEntry
+// +--------------+
+
+const char kIndexMagic[8] = {'B', 'S', 'I', 'N', 'D', 'E', 'X', '\0'};
+const uint32_t kIndexVersion = 5;
+
+struct Section {
+  uint64_t offset;  // 相对文件开头的偏移
+  uint64_t size;
+};
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t posting_codec;  // PostingCodec, 整个文件使用同一种编码方式
+  uint32_t reserved;
+  uint64_t doc_count;
+  uint64_t term_count;
+  Section doc_data;
+  Section doc_offsets;
+  Section postings;
+  Section term_entries;
+  Section term_keys;
+  Section term_hash;
+  uint64_t file_size;
+};
+
+struct TermEntry {
+  uint64_t key_offset;      // 在 term_keys 中的偏移
+  uint64_t posting_offset;  // 在 postings 中的偏移
+  uint64_t top_offset;      // weight 最大的 top_count 个 Posting 在 postings 中的偏移
+  uint32_t key_size;
+  uint32_t posting_count;   // 拉链中元素的个数
+  int32_t max_weight;       // 拉链中最大的 weight, 用于动态剪枝
+  uint32_t top_count;
+};
+
+// hash 表中的一个槽位. 装载因子不超过 0.5, 查找时一定能遇到空槽位而结束
+struct TermSlot {
+  uint32_t term;  // TermEntry 的下标 + 1, 0 表示空槽位
+  uint32_t tag;   // key 的 hash 值的高 32 位, 相同时才需要比较 key
+};
+
+// 文档的头部, 后面紧跟着 title, content, show_url, jump_url 的内容
+struct DocRecord {
+  uint32_t title_size;
+  uint32_t content_size;
+  uint32_t show_url_size;
+  uint32_t jump_url_size;
+};
+
+// 一个文档的视图, 直接指向 mmap 的内存
+class DocView {
+public:
+  DocView() : record_(NULL) {}
+  explicit DocView(const DocRecord* record) : record_(record) {}
+
+  boost::string_ref title() const {
+    return boost::string_ref(Data(), record_->title_size);
+  }
+  boost::string_ref content() const {
+    return boost::string_ref(Data() + record_->title_size, record_->content_size);
+  }
+  boost::string_ref show_url() const {
+    return boost::string_ref(Data() + record_->title_size + record_->content_size,
+                             record_->show_url_size);
+  }
+  boost::string_ref jump_url() const {
+    return boost::string_ref(Data() + record_->title_size + record_->content_size
+                             + record_->show_url_size, record_->jump_url_size);
+  }
+
+private:
+  const char* Data() const {
+    return reinterpret_cast<const char*>(record_ + 1);
+  }
+  const DocRecord* record_;
+};
+
+// 以流的方式写索引文件. 先按照 doc_id 的顺序写完所有文档,
+// 再按照 key 升序写所有倒排拉链(拉链本身按照 doc_id 升序), 最后调用 Finish.
+// 文档和拉链写完就不再占用内存, 但 doc_offsets, term_entries 和 term_keys 一直保留到
+// Finish(最后还要在内存中生成 hash 表), 和文档数、词数成正比: 每个文档 8 字节,
+// 每个词 TermEntry 40 字节, hash 表的槽位最多 32 字节, 再加上词本身的长度.
+// 先写到 path.tmp, Finish 时再改名成 path. 搜索服务器正在 mmap 的旧文件
+// 不会被截断, 改名之后重新加载即可切换到新文件
+class IndexWriter {
+public:
+  IndexWriter();
+
+  // 元素个数超过一块的拉链, 额外保存 weight 最大的 top_num 个元素
+  bool Open(const std::string& path, PostingCodec codec, uint32_t top_num);
+  bool AddDoc(const doc_index_proto::DocInfo& doc_info);
+  bool AddTerm(const std::string& key, const std::vector<Posting>& postings);
+  bool Finish();
+
+  // 上面说的和文档数、词数成正比的部分当前占用的内存(字节), 不包括 hash 表
+  size_t MemoryBytes() const {
+    return doc_offsets_.capacity() * sizeof(uint64_t)
+         + term_entries_.capacity() * sizeof(TermEntry) + term_keys_.capacity();
+  }
+
+private:
+  void Write(const void* data, size_t size);
+  void Align();
+  void FinishDocs();
+  void WriteTermHash();
+
+  std::string path_;
+  std::ofstream file_;
+  uint64_t offset_;
+  FileHeader header_;
+  bool docs_finished_;
+  std::vector<uint64_t> doc_offsets_;
+  std::vector<TermEntry> term_entries_;
+  std::string term_keys_;
+  std::string last_key_;
+  std::string posting_buf_;
+  uint32_t top_num_;
+  std::vector<Posting> top_buf_;
+};
+
+// 通过 mmap 加载索引文件, 提供只读的查询接口
+class IndexReader {
+public:
+  IndexReader();
+  ~IndexReader();
+
+  bool Open(const std::string& path);
+  // 把整个文件读入内存并建立好映射, 之后的查询不会再因为缺页而变慢
+  void Warm() const;
+
+  uint64_t doc_count() const { return header_->doc_count; }
+  uint64_t term_count() const { return header_->term_count; }
+
+  bool GetDoc(uint64_t doc_id, DocView* doc) const;
+  bool GetPostingList(boost::string_ref key, PostingList* list) const;
+  // 查找 key 对应的 TermEntry 的下标
+  bool FindTerm(boost::string_ref key, uint64_t* term_index) const;
+
+  // 按照下标遍历所有的关键词, 调试用
+  boost::string_ref GetTermKey(uint64_t term_index) const;
+  PostingList GetTermPostings(uint64_t term_index) const;
+
+private:
+  IndexReader(const IndexReader&);
+  IndexReader& operator=(const IndexReader&);
+
+  bool CheckSection(const Section& section) const;
+
+  const char* base_;
+  size_t size_;
+  const FileHeader* header_;
+  const char* doc_data_;
+  const uint64_t* doc_offsets_;
+  const char* postings_;
+  const TermEntry* term_entries_;
+  const char* term_keys_;
+  const TermSlot* term_hash_;
+  uint64_t hash_mask_;
+};
+
+}  // end doc_index
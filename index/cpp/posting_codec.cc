@@ -0,0 +1,301 @@
+#include <string.h>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <base/base.h>
+#include "posting_codec.h"
+
+namespace doc_index {
+
+bool ParsePostingCodec(const std::string& name, PostingCodec* codec) {
+  if (name == "raw") {
+    *codec = kRawCodec;
+  } else if (name == "varint") {
+    *codec = kVarintCodec;
+  } else if (name == "block") {
+    *codec = kBlockCodec;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static void PutVarint(uint32_t value, std::string* output) {
+  while (value >= 0x80) {
+    output->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  output->push_back(static_cast<char>(value));
+}
+
+static const uint8_t* GetVarint(const uint8_t* p, uint32_t* value) {
+  uint32_t result = 0;
+  for (int shift = 0; ; shift += 7) {
+    uint8_t byte = *p++;
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      break;
+    }
+  }
+  *value = result;
+  return p;
+}
+
+// 能容纳 max_value 的最小宽度(字节)
+static uint8_t PackWidth(uint32_t max_value) {
+  if (max_value <= 0xff) {
+    return 1;
+  }
+  if (max_value <= 0xffff) {
+    return 2;
+  }
+  return 4;
+}
+
+static void Pack(const uint32_t* values, size_t n, uint8_t width, std::string* output) {
+  for (size_t i = 0; i < n; ++i) {
+    // 只支持小端机器, 直接取低位的 width 个字节
+    output->append(reinterpret_cast<const char*>(&values[i]), width);
+  }
+}
+
+// 把 n 个宽度为 width 字节的无符号整数展开成 uint32_t
+static void Unpack(const uint8_t* input, uint8_t width, size_t n, uint32_t* output) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  if (width == 1) {
+    for (; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+      __m128i lo = _mm_unpacklo_epi8(v, zero);
+      __m128i hi = _mm_unpackhi_epi8(v, zero);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_unpacklo_epi16(lo, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 4), _mm_unpackhi_epi16(lo, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 8), _mm_unpacklo_epi16(hi, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 12), _mm_unpackhi_epi16(hi, zero));
+    }
+  } else if (width == 2) {
+    for (; i + 8 <= n; i += 8) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 2 * i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), _mm_unpacklo_epi16(v, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i + 4), _mm_unpackhi_epi16(v, zero));
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    uint32_t value = 0;
+    memcpy(&value, input + width * i, width);
+    output[i] = value;
+  }
+}
+
+// 前缀和, 把差分还原成 doc_id
+static void PrefixSum(uint32_t* data, size_t n, uint32_t base) {
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i carry = _mm_set1_epi32(base);
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, carry);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), x);
+    carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  base = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+#endif
+  for (; i < n; ++i) {
+    base += data[i];
+    data[i] = base;
+  }
+}
+
+void EncodePostings(PostingCodec codec, const std::vector<Posting>& postings,
+                    std::string* output) {
+  const size_t beg = output->size();
+  const uint32_t block_count = (postings.size() + kPostingBlockSize - 1) / kPostingBlockSize;
+  // 先占住 BlockMeta 的位置, 每块写完之后再填
+  output->resize(beg + block_count * sizeof(BlockMeta));
+  std::vector<BlockMeta> metas(block_count);
+  uint32_t prev_doc_id = 0;
+  uint32_t deltas[kPostingBlockSize];
+  uint32_t weights[kPostingBlockSize];
+  uint32_t first_pos[kPostingBlockSize];
+  for (uint32_t block = 0; block < block_count; ++block) {
+    const size_t offset = block * kPostingBlockSize;
+    const size_t n = std::min<size_t>(kPostingBlockSize, postings.size() - offset);
+    metas[block].offset = output->size() - beg;
+    metas[block].max_weight = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const Posting& posting = postings[offset + i];
+      CHECK(posting.doc_id >= prev_doc_id && (posting.doc_id > prev_doc_id || offset + i == 0))
+        << "postings not sorted by doc_id! doc_id=" << posting.doc_id;
+      deltas[i] = posting.doc_id - prev_doc_id;
+      weights[i] = posting.weight;
+      first_pos[i] = posting.first_pos + 1;
+      prev_doc_id = posting.doc_id;
+      metas[block].max_weight = std::max(metas[block].max_weight, posting.weight);
+    }
+    metas[block].last_doc_id = prev_doc_id;
+    if (codec == kRawCodec) {
+      output->append(reinterpret_cast<const char*>(&postings[offset]), n * sizeof(Posting));
+    } else if (codec == kVarintCodec) {
+      for (size_t i = 0; i < n; ++i) {
+        PutVarint(deltas[i], output);
+        PutVarint(weights[i], output);
+        PutVarint(first_pos[i], output);
+      }
+    } else {
+      uint8_t widths[3] = {
+        PackWidth(*std::max_element(deltas, deltas + n)),
+        PackWidth(*std::max_element(weights, weights + n)),
+        PackWidth(*std::max_element(first_pos, first_pos + n)),
+      };
+      output->append(reinterpret_cast<const char*>(widths), sizeof(widths));
+      Pack(deltas, n, widths[0], output);
+      Pack(weights, n, widths[1], output);
+      Pack(first_pos, n, widths[2], output);
+    }
+  }
+  if (block_count > 0) {
+    memcpy(&(*output)[beg], metas.data(), block_count * sizeof(BlockMeta));
+  }
+}
+
+int32_t MaxWeight(const std::vector<Posting>& postings) {
+  int32_t max_weight = 0;
+  for (size_t i = 0; i < postings.size(); ++i) {
+    max_weight = std::max(max_weight, postings[i].weight);
+  }
+  return max_weight;
+}
+
+void TopPostings(const std::vector<Posting>& postings, size_t n, std::vector<Posting>* top) {
+  n = std::min(n, postings.size());
+  top->resize(n);
+  std::partial_sort_copy(postings.begin(), postings.end(), top->begin(), top->end(),
+      [](const Posting& p1, const Posting& p2) {
+        return p1.weight > p2.weight || (p1.weight == p2.weight && p1.doc_id < p2.doc_id);
+      });
+}
+
+PostingCursor::PostingCursor()
+  : metas_(NULL), block_count_(0), block_(0), block_len_(0), pos_(0) {}
+
+PostingCursor::PostingCursor(const PostingList& list) {
+  Reset(list);
+}
+
+void PostingCursor::Reset(const PostingList& list) {
+  list_ = list;
+  metas_ = reinterpret_cast<const BlockMeta*>(list.data);
+  block_count_ = (list.size + kPostingBlockSize - 1) / kPostingBlockSize;
+  block_ = 0;
+  block_len_ = 0;
+  pos_ = 0;
+  if (block_count_ > 0) {
+    DecodeBlock(0);
+  }
+}
+
+void PostingCursor::DecodeBlock(uint32_t block) {
+  block_ = block;
+  pos_ = 0;
+  block_len_ = std::min(kPostingBlockSize, list_.size - block * kPostingBlockSize);
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(list_.data) + metas_[block].offset;
+  if (list_.codec == kRawCodec) {
+    for (uint32_t i = 0; i < block_len_; ++i, p += sizeof(Posting)) {
+      Posting posting;
+      memcpy(&posting, p, sizeof(posting));
+      doc_ids_[i] = posting.doc_id;
+      weights_[i] = posting.weight;
+      first_pos_[i] = posting.first_pos + 1;
+    }
+    return;
+  }
+  const uint32_t base = block == 0 ? 0 : metas_[block - 1].last_doc_id;
+  if (list_.codec == kVarintCodec) {
+    uint32_t doc_id = base;
+    for (uint32_t i = 0; i < block_len_; ++i) {
+      uint32_t delta = 0;
+      p = GetVarint(p, &delta);
+      p = GetVarint(p, &weights_[i]);
+      p = GetVarint(p, &first_pos_[i]);
+      doc_id += delta;
+      doc_ids_[i] = doc_id;
+    }
+    return;
+  }
+  const uint8_t* widths = p;
+  p += 3;
+  Unpack(p, widths[0], block_len_, doc_ids_);
+  p += widths[0] * block_len_;
+  Unpack(p, widths[1], block_len_, weights_);
+  p += widths[1] * block_len_;
+  Unpack(p, widths[2], block_len_, first_pos_);
+  PrefixSum(doc_ids_, block_len_, base);
+}
+
+Posting PostingCursor::Get() const {
+  Posting posting;
+  posting.doc_id = doc_id();
+  posting.weight = weight();
+  posting.first_pos = first_pos();
+  return posting;
+}
+
+void PostingCursor::Next() {
+  if (++pos_ < block_len_) {
+    return;
+  }
+  if (block_ + 1 < block_count_) {
+    DecodeBlock(block_ + 1);
+  }
+}
+
+void PostingCursor::SkipTo(uint32_t target) {
+  if (!Valid() || doc_id() >= target) {
+    return;
+  }
+  // 先根据 BlockMeta 找到 target 所在的块, 再在块内查找
+  if (metas_[block_].last_doc_id < target) {
+    const BlockMeta* meta = std::lower_bound(metas_ + block_ + 1, metas_ + block_count_, target,
+        [](const BlockMeta& m, uint32_t doc_id) { return m.last_doc_id < doc_id; });
+    if (meta == metas_ + block_count_) {
+      pos_ = block_len_;
+      return;
+    }
+    DecodeBlock(meta - metas_);
+  }
+  while (doc_ids_[pos_] < target) {
+    ++pos_;
+  }
+}
+
+bool PostingCursor::BlockBound(uint32_t target, uint32_t* last_doc_id,
+                               int32_t* max_weight) const {
+  if (!Valid()) {
+    return false;
+  }
+  const BlockMeta* meta = metas_ + block_;
+  if (meta->last_doc_id < target) {
+    meta = std::lower_bound(metas_ + block_ + 1, metas_ + block_count_, target,
+        [](const BlockMeta& m, uint32_t doc_id) { return m.last_doc_id < doc_id; });
+    if (meta == metas_ + block_count_) {
+      return false;
+    }
+  }
+  *last_doc_id = meta->last_doc_id;
+  *max_weight = meta->max_weight;
+  return true;
+}
+
+void PostingCursor::DecodeAll(const PostingList& list, std::vector<Posting>* postings) {
+  postings->reserve(postings->size() + list.size);
+  for (PostingCursor cursor(list); cursor.Valid(); cursor.Next()) {
+    postings->push_back(cursor.Get());
+  }
+}
+
+}  // end doc_index
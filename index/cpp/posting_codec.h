@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace doc_index {
+
+// 倒排拉链中的一个元素
+struct Posting {
+  uint32_t doc_id;
+  int32_t weight;
+  // 该关键词在正文中第一次出现的位置, -1 表示没有出现过
+  int32_t first_pos;
+};
+
+// 倒排拉链的压缩方式. 拉链都按照 doc_id 升序排列, 每 kPostingBlockSize
+// 个元素分为一块, 每块的 doc_id 都相对上一块的最后一个 doc_id 做差分.
+// a) raw:    不压缩, 每个元素就是一个 Posting, 解码最快
+// b) varint: 差分后的 doc_id, weight, first_pos + 1 依次按照变长整数编码,
+//            体积最小, 只能逐个解码
+// c) block:  块内三个字段分别存成定长的数组, 宽度按块内最大值取 1/2/4 字节,
+//            可以用 SIMD 指令整块解码. 体积和解码速度介于前两者之间
+enum PostingCodec {
+  kRawCodec = 0,
+  kVarintCodec = 1,
+  kBlockCodec = 2,
+};
+
+const uint32_t kPostingBlockSize = 128;
+
+// 每条拉链的开头是一个 BlockMeta 数组, 用于在拉链中快速跳转,
+// 以及在查询时估计一个块内文档得分的上界(动态剪枝)
+struct BlockMeta {
+  uint32_t last_doc_id;  // 块内最后一个 doc_id
+  uint32_t offset;       // 块的数据相对拉链开头的偏移
+  int32_t max_weight;    // 块内最大的 weight
+};
+
+bool ParsePostingCodec(const std::string& name, PostingCodec* codec);
+
+// 把按照 doc_id 升序排列的拉链编码后追加到 output 中
+void EncodePostings(PostingCodec codec, const std::vector<Posting>& postings,
+                    std::string* output);
+
+// 拉链中最大的 weight, 拉链为空时是 0
+int32_t MaxWeight(const std::vector<Posting>& postings);
+
+// 取出 weight 最大的 n 个元素, 按照 weight 降序排列, weight 相同时 doc_id 小的在前
+void TopPostings(const std::vector<Posting>& postings, size_t n, std::vector<Posting>* top);
+
+// 一条编码后的倒排拉链, 直接指向 mmap 的内存
+struct PostingList {
+  const char* data;
+  uint32_t size;  // 拉链中元素的个数
+  PostingCodec codec;
+  int32_t max_weight;  // 拉链中最大的 weight
+  // 拉链中 weight 最大的 top_size 个元素, 按照 TopPostings 的顺序排列, 不压缩.
+  // 短拉链不保存, 此时 top_size 为 0
+  const Posting* top;
+  uint32_t top_size;
+
+  PostingList() : data(NULL), size(0), codec(kRawCodec), max_weight(0),
+                  top(NULL), top_size(0) {}
+};
+
+// 按照 doc_id 升序遍历一条拉链, 每次解码一块
+class PostingCursor {
+public:
+  PostingCursor();
+  explicit PostingCursor(const PostingList& list);
+
+  void Reset(const PostingList& list);
+
+  bool Valid() const { return pos_ < block_len_; }
+  uint32_t doc_id() const { return doc_ids_[pos_]; }
+  int32_t weight() const { return static_cast<int32_t>(weights_[pos_]); }
+  int32_t first_pos() const { return static_cast<int32_t>(first_pos_[pos_]) - 1; }
+  Posting Get() const;
+  int32_t max_weight() const { return list_.max_weight; }
+
+  void Next();
+  // 跳到第一个 doc_id >= target 的位置
+  void SkipTo(uint32_t target);
+  // 只查 BlockMeta, 不解码: 从当前块开始找到可能包含 target 的块,
+  // 返回块内最后一个 doc_id 和最大的 weight. target 超过拉链末尾时返回 false
+  bool BlockBound(uint32_t target, uint32_t* last_doc_id, int32_t* max_weight) const;
+
+  // 把整条拉链解码后追加到 postings 中
+  static void DecodeAll(const PostingList& list, std::vector<Posting>* postings);
+
+private:
+  void DecodeBlock(uint32_t block);
+
+  PostingList list_;
+  const BlockMeta* metas_;
+  uint32_t block_count_;
+  uint32_t block_;       // 当前解码的是第几块
+  uint32_t block_len_;   // 当前块中的元素个数
+  uint32_t pos_;         // 当前元素在块中的下标
+  // 解码的结果按照字段分开存放, 方便 SIMD 处理. first_pos 存的是 +1 之后的值
+  uint32_t doc_ids_[kPostingBlockSize];
+  uint32_t weights_[kPostingBlockSize];
+  uint32_t first_pos_[kPostingBlockSize];
+};
+
+}  // end doc_index
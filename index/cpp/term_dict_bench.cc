@@ -0,0 +1,96 @@
+// 关键词词典查找的性能测试.
+// 用真实索引文件中的词表, 比较以下三种查找方式每次查找的平均耗时:
+// a) unordered_map: 以前内存索引的做法, 需要先构造 std::string 作为 key
+// b) binary_search: 在按 key 排序的 term_entries 上二分查找
+// c) flat_hash:     索引文件中开放寻址的 hash 表, 直接用 string_ref 查找
+#include <sys/time.h>
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <base/base.h>
+#include "index_file.h"
+
+DEFINE_string(index_path, "../data/output/index_file",
+              "索引文件的路径");
+DEFINE_int32(lookup_num, 2000000, "每种方式查找的次数");
+DEFINE_int32(miss_percent, 10, "查找不存在的关键词所占的百分比");
+
+static int64_t NowUs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static bool BinarySearch(const doc_index::IndexReader& reader,
+                         boost::string_ref key, uint64_t* term_index) {
+  uint64_t beg = 0;
+  uint64_t end = reader.term_count();
+  while (beg < end) {
+    uint64_t mid = beg + (end - beg) / 2;
+    int cmp = reader.GetTermKey(mid).compare(key);
+    if (cmp == 0) {
+      *term_index = mid;
+      return true;
+    }
+    if (cmp < 0) {
+      beg = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return false;
+}
+
+template <typename Func>
+static void Run(const char* name, const std::vector<boost::string_ref>& queries, Func func) {
+  uint64_t found = 0;
+  int64_t beg = NowUs();
+  for (size_t i = 0; i < queries.size(); ++i) {
+    found += func(queries[i]);
+  }
+  int64_t cost = NowUs() - beg;
+  printf("%-14s %8.1f ns/lookup  found=%lu\n", name,
+         cost * 1000.0 / queries.size(), found);
+}
+
+int main(int argc, char* argv[]) {
+  base::InitApp(argc, argv);
+  doc_index::IndexReader reader;
+  CHECK(reader.Open(fLS::FLAGS_index_path));
+  CHECK(reader.term_count() > 0);
+
+  std::unordered_map<std::string, uint64_t> map;
+  std::vector<std::string> missing;
+  for (uint64_t i = 0; i < reader.term_count(); ++i) {
+    boost::string_ref key = reader.GetTermKey(i);
+    map[key.to_string()] = i;
+    // 在关键词后面加一个字节, 构造出词表中不存在的 key
+    missing.push_back(key.to_string() + "#");
+  }
+
+  // 查询序列预先生成好, 每种方式使用相同的序列
+  std::mt19937 rng(0);
+  std::vector<boost::string_ref> queries(fLI::FLAGS_lookup_num);
+  for (size_t i = 0; i < queries.size(); ++i) {
+    uint64_t term_index = rng() % reader.term_count();
+    if (static_cast<int>(rng() % 100) < fLI::FLAGS_miss_percent) {
+      queries[i] = missing[term_index];
+    } else {
+      queries[i] = reader.GetTermKey(term_index);
+    }
+  }
+  printf("term_count=%lu lookup_num=%lu\n", reader.term_count(), queries.size());
+
+  Run("unordered_map", queries, [&](boost::string_ref key) {
+    return map.find(key.to_string()) != map.end();
+  });
+  Run("binary_search", queries, [&](boost::string_ref key) {
+    uint64_t term_index = 0;
+    return BinarySearch(reader, key, &term_index);
+  });
+  Run("flat_hash", queries, [&](boost::string_ref key) {
+    uint64_t term_index = 0;
+    return reader.FindTerm(key, &term_index);
+  });
+  return 0;
+}
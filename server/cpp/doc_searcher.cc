@@ -1,94 +1,556 @@
 #include "doc_searcher.h"
+#include "query_log.h"
+#include <list>
+#include <unordered_set>
 #include <base/base.h>
 
 DEFINE_int32(desc_max_size, 160, "描述的最大长度");
+DEFINE_int32(max_result_num, 1000, "单次请求最多能翻到第几条结果(offset + limit)");
+DEFINE_string(rank_method, "exhaustive", "多路归并的方式: exhaustive(遍历所有拉链), "
+              "wand, bmw(Block-Max WAND), 三者的结果完全一致");
+DEFINE_int32(result_cache_mb, 64, "查询结果缓存的大小(MB), 0 表示不使用缓存");
+DEFINE_int32(result_cache_shards, 16, "查询结果缓存的分片数, 分片越多锁竞争越少");
+DEFINE_int32(max_queue_ms, 100, "请求排队超过这个时间(毫秒)就不再处理, 0 表示不限制");
+DEFINE_int32(default_deadline_ms, 0, "请求中没有指定 deadline_ms 时的处理时间上限(毫秒), "
+             "0 表示不限制");
 
 namespace doc_server {
 
-bool DocSearcher::Search(const Request& req, Response* resp) {
+static const char* kStatNames[kStatNum] = {
+  "cut_query", "cache", "retrieve", "rank", "package", "log", "total", "queue",
+  "posting_num", "result_num",
+};
+
+static std::atomic<uint64_t> shed_num(0);
+
+// 排序时每处理这么多个文档检查一次是否超时, 必须是 2 的幂
+static const uint32_t kDeadlineCheckInterval = 256;
+
+void DocSearcher::Reject(const Request& req, Response* resp) {
+  resp->set_sid(req.sid());
+  resp->set_timestamp(common::TimeUtil::TimeStamp());
+  resp->set_err_code(kErrOverload);
+  ++shed_num;
+}
+
+bool DocSearcher::Search(const Request& req, Response* resp, int64_t queue_ns) {
+  // 排队太久说明服务器已经处理不过来了, 客户端很可能已经超时,
+  // 直接返回错误, 把时间留给后面的请求
+  GetHistograms()->Add(kStatQueue, queue_ns);
+  if (FLAGS_max_queue_ms > 0 && queue_ns > FLAGS_max_queue_ms * 1000000L) {
+    Reject(req, resp);
+    return false;
+  }
   Context context(&req, resp);
+  context.index = Index::Instance()->GetSnapshot();
+  Prepare(&context, queue_ns);
+  Finish(&context);
+  return true;
+}
+
+void DocSearcher::Prepare(Context* context, int64_t queue_ns) {
+  context->begin_ns = common::TimeUtil::MonotonicNS();
+  context->stage_ns = context->begin_ns;
+  const int32_t deadline_ms = context->req->deadline_ms() > 0
+                              ? context->req->deadline_ms() : FLAGS_default_deadline_ms;
+  if (deadline_ms > 0) {
+    context->deadline_ns = context->begin_ns - queue_ns + deadline_ms * 1000000L;
+  }
   // 1. 对查询词进行分词
-  CutQuery(&context);
-  // 2. 根据分词结果进行触发
-  Retrieve(&context);
-  // 3. 根据触发结果进行排序
-  Rank(&context);
-  // 4. 根据排序结果进行包装响应
-  PackageResponse(&context);
+  CutQuery(context);
+  EndStage(kStatCutQuery, context);
+  // 分词结果相同的查询, 结果也相同, 先查缓存
+  LookupCache(context);
+  EndStage(kStatCache, context);
+}
+
+void DocSearcher::Finish(Context* context) {
+  // 批量查询时两步之间可能等待了一段时间, 不算到下一个阶段中
+  context->stage_ns = common::TimeUtil::MonotonicNS();
+  if (!context->cache_hit) {
+    // 2. 根据分词结果进行触发
+    Retrieve(context);
+    EndStage(kStatRetrieve, context);
+    // 3. 根据触发结果进行排序
+    Rank(context);
+    EndStage(kStatRank, context);
+    // 4. 根据排序结果进行包装响应
+    PackageResponse(context);
+    UpdateCache(context);
+    EndStage(kStatPackage, context);
+  }
   // 5. 记录处理日志
-  Log(&context);
-  return true;
+  Log(context);
+  EndStage(kStatLog, context);
+  common::HistogramSet* histograms = GetHistograms();
+  histograms->Add(kStatTotal, context->stage_ns - context->begin_ns);
+  if (!context->cache_hit) {
+    histograms->Add(kStatPostingNum, context->posting_num);
+  }
+  histograms->Add(kStatResultNum, context->resp->item_size());
+}
+
+// 一次批量查询的共享状态, 最后一个处理完的线程负责调用 done
+struct BatchState {
+  std::vector<Context> contexts;
+  // 多个请求共用的查询词, 拉链解码之后重新按照 raw 的方式编码, 保存在 buffers 中
+  SharedLists shared_lists;
+  std::list<std::string> buffers;
+  // 下一个要处理的请求, 以及还没有结束的线程数
+  std::atomic<size_t> next;
+  std::atomic<size_t> running;
+  std::function<void()> done;
+
+  BatchState() : next(0), running(0) {}
+};
+
+static void RunBatch(const std::shared_ptr<BatchState>& state) {
+  DocSearcher searcher;
+  size_t i = 0;
+  while ((i = state->next++) < state->contexts.size()) {
+    searcher.Finish(&state->contexts[i]);
+  }
+  if (--state->running == 0) {
+    state->done();
+  }
+}
+
+void DocSearcher::SearchBatch(const BatchRequest& req, BatchResponse* resp, int64_t queue_ns,
+                              common::WorkStealingPool* pool, std::function<void()> done) {
+  for (int i = 0; i < req.request_size(); ++i) {
+    resp->add_response();
+  }
+  GetHistograms()->Add(kStatQueue, queue_ns);
+  if (FLAGS_max_queue_ms > 0 && queue_ns > FLAGS_max_queue_ms * 1000000L) {
+    for (int i = 0; i < req.request_size(); ++i) {
+      Reject(req.request(i), resp->mutable_response(i));
+    }
+    done();
+    return;
+  }
+  // 1. 在当前线程中给所有请求分词, 所有请求使用同一个版本的索引
+  std::shared_ptr<BatchState> state(new BatchState());
+  state->done = std::move(done);
+  doc_index::IndexSnapshotPtr index = Index::Instance()->GetSnapshot();
+  DocSearcher searcher;
+  std::unordered_map<std::string, int> word_count;
+  state->contexts.reserve(req.request_size());
+  for (int i = 0; i < req.request_size(); ++i) {
+    state->contexts.push_back(Context(&req.request(i), resp->mutable_response(i)));
+    Context* context = &state->contexts.back();
+    context->index = index;
+    context->shared_lists = &state->shared_lists;
+    searcher.Prepare(context, queue_ns);
+    if (context->cache_hit) {
+      continue;
+    }
+    std::unordered_set<std::string> words(context->words.begin(), context->words.end());
+    for (const auto& word : words) {
+      ++word_count[word];
+    }
+  }
+  // 2. 多个请求共用的查询词只解码一次, 之后按照 raw 的方式遍历, 不需要再解码
+  std::vector<doc_index::Posting> postings;
+  for (const auto& word : word_count) {
+    PostingList list;
+    if (word.second < 2 || !index->GetInvertedList(word.first, &list)
+        || list.codec == doc_index::kRawCodec) {
+      continue;
+    }
+    postings.clear();
+    PostingCursor::DecodeAll(list, &postings);
+    state->buffers.push_back(std::string());
+    doc_index::EncodePostings(doc_index::kRawCodec, postings, &state->buffers.back());
+    list.data = state->buffers.back().data();
+    list.codec = doc_index::kRawCodec;
+    state->shared_lists[word.first] = list;
+  }
+  // 3. 剩下的步骤在线程池中并行处理, 每个线程每次取一个请求.
+  //    线程池的队列满了就少用几个线程, 当前线程也参与处理
+  const size_t thread_num = std::min<size_t>(pool->thread_num(), state->contexts.size());
+  state->running = thread_num > 0 ? thread_num : 1;
+  for (size_t i = 1; i < thread_num; ++i) {
+    if (!pool->TrySubmit([state]() { RunBatch(state); })) {
+      --state->running;
+    }
+  }
+  RunBatch(state);
+}
+
+common::HistogramSet* DocSearcher::GetHistograms() {
+  static common::HistogramSet histograms(kStatNum);
+  return &histograms;
+}
+
+void DocSearcher::EndStage(Stat stat, Context* context) {
+  const int64_t now = common::TimeUtil::MonotonicNS();
+  GetHistograms()->Add(stat, now - context->stage_ns);
+  context->stage_cost_ns[stat] = now - context->stage_ns;
+  context->stage_ns = now;
+}
+
+void DocSearcher::GetStats(StatsResponse* resp) {
+  std::vector<uint64_t> counts;
+  for (int i = 0; i < kStatNum; ++i) {
+    uint64_t sum = 0;
+    GetHistograms()->Merge(i, &counts, &sum);
+    uint64_t count = 0;
+    for (auto c : counts) {
+      count += c;
+    }
+    // 耗时按照微秒输出
+    const double unit = i < kStatTimeEnd ? 1000.0 : 1.0;
+    auto* metric = resp->add_metric();
+    metric->set_name(kStatNames[i]);
+    metric->set_count(count);
+    metric->set_avg(count == 0 ? 0 : sum / unit / count);
+    metric->set_p50(common::Histogram::Percentile(counts, 0.5) / unit);
+    metric->set_p90(common::Histogram::Percentile(counts, 0.9) / unit);
+    metric->set_p99(common::Histogram::Percentile(counts, 0.99) / unit);
+    metric->set_p999(common::Histogram::Percentile(counts, 0.999) / unit);
+  }
+  resp->set_cache_hits(CacheHits());
+  resp->set_cache_misses(CacheMisses());
+  resp->set_shed_num(shed_num);
 }
 
 bool DocSearcher::CutQuery(Context* context) {
   // 使用 Jieba 分词来切分, 需要去掉暂停词
   Index* index = Index::Instance();
   index->CutWordWithoutStopWord(context->req->query(), &context->words);
-  LOG(INFO) << "CutQuery Done! sid=" << context->req->sid();
+  // 顺便整理分页参数, offset + limit 不能超过 max_result_num
+  const Request* req = context->req;
+  context->offset = std::min(std::max(req->offset(), 0), FLAGS_max_result_num);
+  context->limit = std::max(std::min(req->limit(), FLAGS_max_result_num - context->offset), 0);
+  VLOG(1) << "CutQuery Done! sid=" << context->req->sid();
+  return true;
+}
+
+ResultCache* DocSearcher::GetCache() {
+  // 所有的 DocSearcher 共用一个缓存, 第一次使用时创建
+  static ResultCache cache(static_cast<size_t>(std::max(FLAGS_result_cache_mb, 0)) << 20,
+                           std::max(FLAGS_result_cache_shards, 1));
+  return &cache;
+}
+
+uint64_t DocSearcher::CacheHits() {
+  return GetCache()->hits();
+}
+
+uint64_t DocSearcher::CacheMisses() {
+  return GetCache()->misses();
+}
+
+void DocSearcher::ClearCache() {
+  GetCache()->Clear();
+}
+
+bool DocSearcher::LookupCache(Context* context) {
+  if (FLAGS_result_cache_mb <= 0) {
+    return false;
+  }
+  // key 由索引的版本号, 分页参数和分词结果组成. 重新加载索引之后版本号变化,
+  // 旧的结果不会再被命中, 之后会被慢慢淘汰掉
+  std::string& key = context->cache_key;
+  key = std::to_string(context->index->generation()) + ' '
+        + std::to_string(context->offset) + ' ' + std::to_string(context->limit);
+  for (const auto& word : context->words) {
+    key.push_back('\0');
+    key.append(word);
+  }
+  std::shared_ptr<const Response> cached;
+  if (!GetCache()->Get(key, &cached)) {
+    return false;
+  }
+  context->cache_hit = true;
+  context->resp->CopyFrom(*cached);
+  context->resp->set_sid(context->req->sid());
+  context->resp->set_timestamp(common::TimeUtil::TimeStamp());
   return true;
 }
 
+void DocSearcher::UpdateCache(Context* context) {
+  // 不完整的结果不能缓存
+  if (FLAGS_result_cache_mb <= 0 || context->resp->err_code() != 0 || context->partial) {
+    return;
+  }
+  std::shared_ptr<const Response> cached(new Response(*context->resp));
+  // 按照序列化的大小估算占用的内存
+  GetCache()->Put(context->cache_key, cached,
+                  context->cache_key.size() + cached->ByteSizeLong() + sizeof(Response));
+}
+
+bool DocSearcher::FindList(const Context& context, const std::string& word,
+                           PostingList* list) {
+  // 批量查询时优先使用已经解码过的拉链
+  if (context.shared_lists != NULL) {
+    auto it = context.shared_lists->find(word);
+    if (it != context.shared_lists->end()) {
+      *list = it->second;
+      return true;
+    }
+  }
+  return context.index->GetInvertedList(word, list);
+}
+
+bool DocSearcher::Expired(Context* context) {
+  if (context->deadline_ns > 0 && common::TimeUtil::MonotonicNS() > context->deadline_ns) {
+    context->partial = true;
+  }
+  return context->partial;
+}
+
 bool DocSearcher::Retrieve(Context* context) {
-  Index* index = Index::Instance();
-  // 根据分词的结果, 去从索引中找到所有的倒排拉链
+  // 根据分词的结果, 去从索引中找到所有的倒排拉链.
+  // 此处只是拿到拉链的位置, 不做解码
   for (const auto& word : context->words) {
-    const doc_index::InvertedList* inverted_list = index->GetInvertedList(word);
-    if (inverted_list == NULL) {
+    // 超时之后不再查找剩下的查询词
+    if (Expired(context)) {
+      break;
+    }
+    PostingList inverted_list;
+    if (!FindList(*context, word, &inverted_list)) {
       // 针对该分词结果, 没找到倒排拉链
       continue;
     }
-    for (size_t i = 0; i < inverted_list->size(); ++i) {
-      const auto& weight = (*inverted_list)[i];
-      context->all_query_chain.push_back(&weight);
+    // 同一个词在查询中出现多次时只算一次
+    bool dup = false;
+    for (const auto& list : context->lists) {
+      dup = dup || list.data == inverted_list.data;
+    }
+    if (!dup) {
+      context->lists.push_back(inverted_list);
+      context->posting_num += inverted_list.size;
     }
   }
-  // 当此循环结束之后, 所有分词结果对应的倒排信息就都放到
-  // all_query_chain vector 之中了
   return true;
 }
 
 bool DocSearcher::Rank(Context* context) {
-  // 虽然之前在制作索引过程中已经对每个倒排拉链都排过序, 
-  // 但是 all_query_chain 这是一个多个倒排合并得到的最终结果.
-  // 针对这个结果, 还需要进行一个统一的排序
-  // 此处排序规则是要根据所有的 Weight 中的权重进行降序排序
-  std::sort(context->all_query_chain.begin(), context->all_query_chain.end(), CmpWeightPtr);
+  // 只需要用一个大小为 offset + limit 的堆保留最好的结果,
+  // 不需要对所有命中的结果排序
+  const int32_t offset = context->offset;
+  const int32_t limit = context->limit;
+  if (context->lists.size() == 1
+      && RankSingleTerm(context->lists[0], offset, limit, context)) {
+    return true;
+  }
+  TopK top_k(offset + limit);
+  std::vector<doc_index::PostingCursor> cursors(context->lists.size());
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    cursors[i].Reset(context->lists[i]);
+  }
+  if (fLS::FLAGS_rank_method == "wand" || fLS::FLAGS_rank_method == "bmw") {
+    RankWand(context, fLS::FLAGS_rank_method == "bmw", &cursors, &top_k);
+    // 剪枝之后不知道准确的命中数, 用最长的拉链长度估计
+    for (const auto& list : context->lists) {
+      context->total_num = std::max<int32_t>(context->total_num, list.size);
+    }
+  } else {
+    context->total_num = RankExhaustive(context, &cursors, &top_k);
+  }
+  top_k.Finish(&context->results);
+  if ((int32_t)context->results.size() <= offset) {
+    context->results.clear();
+  } else {
+    context->results.erase(context->results.begin(), context->results.begin() + offset);
+  }
   return true;
 }
 
-bool DocSearcher::CmpWeightPtr(const Weight* w1, const Weight* w2) {
-  return w1->weight() > w2->weight();
+bool DocSearcher::RankSingleTerm(const PostingList& list, int32_t offset, int32_t limit,
+                                 Context* context) {
+  // 只有一个查询词时, 文档的得分就是这个词的 weight. 索引中已经按照 weight 降序
+  // 保存了长拉链的前 top_size 个元素, 请求的这一页在其中时直接取出来,
+  // 不需要解码和排序. 短拉链没有保存, 走普通的流程
+  const uint32_t end = offset + limit;
+  if (end > list.top_size && list.top_size < list.size) {
+    return false;
+  }
+  context->total_num = list.size;
+  for (uint32_t i = offset; i < std::min(end, list.top_size); ++i) {
+    const doc_index::Posting& posting = list.top[i];
+    ScoredDoc doc = {posting.doc_id, posting.first_pos, posting.weight};
+    context->results.push_back(doc);
+  }
+  return true;
+}
+
+void DocSearcher::ScoreDoc(uint32_t doc_id, std::vector<PostingCursor>* cursors,
+                           ScoredDoc* doc) {
+  // 按照查询词的顺序累加, 保证不同的检索方式得到的 first_pos 也一样
+  doc->doc_id = doc_id;
+  doc->first_pos = -1;
+  doc->score = 0;
+  int32_t max_weight = -1;
+  for (auto& cursor : *cursors) {
+    if (!cursor.Valid() || cursor.doc_id() != doc_id) {
+      continue;
+    }
+    doc->score += cursor.weight();
+    if (cursor.weight() > max_weight) {
+      max_weight = cursor.weight();
+      doc->first_pos = cursor.first_pos();
+    }
+    cursor.Next();
+  }
+}
+
+int32_t DocSearcher::RankExhaustive(Context* context, std::vector<PostingCursor>* cursors,
+                                    TopK* top_k) {
+  // 所有拉链都按照 doc_id 升序排列, 同时遍历这些拉链(多路归并),
+  // 每次处理当前最小的 doc_id, 把命中的查询词的权重累加成文档的得分.
+  // 这样每个文档只会出现一次. 超时之后只返回已经处理过的文档中最好的结果
+  int32_t total_num = 0;
+  while (true) {
+    if ((total_num & (kDeadlineCheckInterval - 1)) == 0 && Expired(context)) {
+      break;
+    }
+    uint32_t doc_id = UINT32_MAX;
+    bool found = false;
+    for (const auto& cursor : *cursors) {
+      if (cursor.Valid() && (!found || cursor.doc_id() < doc_id)) {
+        doc_id = cursor.doc_id();
+        found = true;
+      }
+    }
+    if (!found) {
+      break;
+    }
+    ScoredDoc doc;
+    ScoreDoc(doc_id, cursors, &doc);
+    ++total_num;
+    top_k->Push(doc);
+  }
+  return total_num;
+}
+
+void DocSearcher::SortCursors(std::vector<PostingCursor*>* sorted) {
+  // 去掉已经遍历完的拉链, 剩下的按照当前 doc_id 升序排列.
+  // 拉链的个数很少, 每次又只有几条拉链向后移动, 插入排序就够了
+  sorted->erase(std::remove_if(sorted->begin(), sorted->end(),
+                [](const PostingCursor* c) { return !c->Valid(); }), sorted->end());
+  for (size_t i = 1; i < sorted->size(); ++i) {
+    PostingCursor* cursor = (*sorted)[i];
+    size_t j = i;
+    for (; j > 0 && (*sorted)[j - 1]->doc_id() > cursor->doc_id(); --j) {
+      (*sorted)[j] = (*sorted)[j - 1];
+    }
+    (*sorted)[j] = cursor;
+  }
+}
+
+void DocSearcher::RankWand(Context* context, bool block_max, std::vector<PostingCursor>* cursors,
+                           TopK* top_k) {
+  // WAND: 每个查询词的得分不会超过它的拉链中最大的 weight.
+  // 把拉链按照当前 doc_id 排序后依次累加这个上界, 第一次超过堆顶分数的
+  // 位置就是 pivot. 比 pivot 的 doc_id 小的文档得分不可能进入结果,
+  // 可以直接跳过, 只有所有靠前的拉链都到达 pivot 时才真正计算得分.
+  // Block-Max WAND 在此基础上再用 pivot 所在块的最大 weight 估计一个更紧的上界,
+  // 上界不够时跳过整块.
+  // 文档按照 doc_id 升序处理, 新的文档只有分数严格大于堆顶时才能进入结果,
+  // 所以上界不超过堆顶分数的文档都可以跳过, 结果和遍历所有拉链完全一致
+  std::vector<PostingCursor*> sorted;
+  for (auto& cursor : *cursors) {
+    sorted.push_back(&cursor);
+  }
+  for (uint32_t round = 0; ; ++round) {
+    if ((round & (kDeadlineCheckInterval - 1)) == 0 && Expired(context)) {
+      break;
+    }
+    SortCursors(&sorted);
+    const int64_t threshold = top_k->Threshold();
+    // 1. 找到 pivot
+    int64_t upper_bound = 0;
+    size_t pivot = sorted.size();
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      upper_bound += sorted[i]->max_weight();
+      if (upper_bound > threshold) {
+        pivot = i;
+        break;
+      }
+    }
+    if (pivot == sorted.size()) {
+      // 剩下的文档都不可能进入结果了
+      break;
+    }
+    const uint32_t pivot_doc_id = sorted[pivot]->doc_id();
+    // 和 pivot 在同一个文档上的拉链也要算进来
+    while (pivot + 1 < sorted.size() && sorted[pivot + 1]->doc_id() == pivot_doc_id) {
+      ++pivot;
+    }
+    // 2. 用 pivot 所在块的最大 weight 再检查一次
+    if (block_max) {
+      int64_t block_bound = 0;
+      // 在 [pivot_doc_id, next_doc_id) 之间的文档, 上界都不会超过 block_bound
+      uint64_t next_doc_id = pivot + 1 < sorted.size()
+                             ? sorted[pivot + 1]->doc_id() : uint64_t(UINT32_MAX) + 1;
+      for (size_t i = 0; i <= pivot; ++i) {
+        uint32_t last_doc_id = 0;
+        int32_t max_weight = 0;
+        if (sorted[i]->BlockBound(pivot_doc_id, &last_doc_id, &max_weight)) {
+          block_bound += max_weight;
+          next_doc_id = std::min<uint64_t>(next_doc_id, uint64_t(last_doc_id) + 1);
+        }
+      }
+      if (block_bound <= threshold) {
+        if (next_doc_id > UINT32_MAX) {
+          break;
+        }
+        for (size_t i = 0; i <= pivot; ++i) {
+          sorted[i]->SkipTo(next_doc_id);
+        }
+        continue;
+      }
+    }
+    // 3. 靠前的拉链都已经到达 pivot 时计算得分, 否则把它们跳到 pivot
+    if (sorted[0]->doc_id() == pivot_doc_id) {
+      ScoredDoc doc;
+      ScoreDoc(pivot_doc_id, cursors, &doc);
+      top_k->Push(doc);
+    } else {
+      for (size_t i = 0; i < pivot && sorted[i]->doc_id() < pivot_doc_id; ++i) {
+        sorted[i]->SkipTo(pivot_doc_id);
+      }
+    }
+  }
 }
 
 bool DocSearcher::PackageResponse(Context* context) {
   // 构造出最终的 Response 结构
-  // all_query_chain 这是这个函数的输入数据. 
+  // results 这是这个函数的输入数据, 只包含需要返回的这一页.
   // 根据这里的文档 id, 查找到对应的相关属性(从正排中查找)
-  Index* index = Index::Instance();
+  const doc_index::IndexSnapshot* index = context->index.get();
   const Request* req = context->req;
   Response* resp = context->resp;
   resp->set_sid(req->sid());
   resp->set_timestamp(common::TimeUtil::TimeStamp());
-  resp->set_err_code(0);
-  for (const auto* weight : context->all_query_chain) {
+  resp->set_err_code(kErrOk);
+  resp->set_total_num(context->total_num);
+  for (const auto& result : context->results) {
     // 查正排, 根据 doc_id, 获取到文档的属性
-    const auto* doc_info = index->GetDocInfo(weight->doc_id());
+    doc_index::DocView doc_info;
+    if (!index->GetDocInfo(result.doc_id, &doc_info)) {
+      continue;
+    }
     // doc_info 数目和返回结果中的 item 是一一对应的
     auto* item = resp->add_item();
-    item->set_title(doc_info->title());
+    item->set_title(doc_info.title().data(), doc_info.title().size());
     // 此处设置描述的时候要根据正文来生成描述.
     // 描述的长度一般是比较短的. 
-    // 描述中一般包含查询词中的部分关键词
-    item->set_desc(GenDesc(weight->first_pos(), doc_info->content()));
-    item->set_jump_url(doc_info->jump_url());
-    item->set_show_url(doc_info->show_url());
+    // 描述中一般包含查询词中的部分关键词.
+    // 生成描述是这里最耗时的部分, 超时之后剩下的结果不再生成描述
+    item->set_desc(Expired(context) ? "" : GenDesc(result.first_pos, doc_info.content()));
+    item->set_jump_url(doc_info.jump_url().data(), doc_info.jump_url().size());
+    item->set_show_url(doc_info.show_url().data(), doc_info.show_url().size());
   }
+  resp->set_partial(context->partial);
   return true;
 }
 
 // 此处的生成描述的策略比较灵活, 核心是为了让用户体验尽量
 // 的好, 能够让用户看到描述就对文章的内容有一定的认知
-std::string DocSearcher::GenDesc(int first_pos, const std::string& content) {
+std::string DocSearcher::GenDesc(int first_pos, boost::string_ref content) {
   // 1. 根据 first_pos 位置开始往前找, 找到这句话的开始位置
   //    (通过标点符号来区分)
   int64_t desc_beg = 0;
@@ -104,11 +566,11 @@ std::string DocSearcher::GenDesc(int first_pos, const std::string& content) {
   if (desc_beg + FLAGS_desc_max_size >= (int32_t)content.size()) {
     // 3. 从句子开始到正文末尾不足描述最大长度 , 就取剩余这部分
     //    的字符串整体作为描述
-    desc = content.substr(desc_beg);
+    desc = content.substr(desc_beg).to_string();
   } else {
     // 4. 从句子开始到正文末尾超过 描述最大长度 , 就把倒数两个字节
     //    修改成 .. , 类似于省略号
-    desc = content.substr(desc_beg, FLAGS_desc_max_size);
+    desc = content.substr(desc_beg, FLAGS_desc_max_size).to_string();
     desc[desc.size() - 1] = '.';
     desc[desc.size() - 2] = '.';
     desc[desc.size() - 3] = '.';
@@ -128,8 +590,35 @@ void DocSearcher::ReplaceEscape(std::string* desc) {
 }
 
 bool DocSearcher::Log(Context* context) {
-  LOG(INFO) << "[Request]" << context->req->Utf8DebugString();
-  LOG(INFO) << "[Response]" << context->resp->Utf8DebugString();
+  // 以前每个请求都用 Utf8DebugString 打印完整的请求和响应, 格式化所有结果的
+  // 标题/描述/url 比检索本身还慢. 现在只抽样记录几个定长的字段,
+  // 格式化和写文件都交给后台线程
+  QueryLog* query_log = QueryLog::Instance();
+  if (!query_log->Sample()) {
+    return true;
+  }
+  const std::string& query = context->req->query();
+  QueryLogRecord record;
+  record.timestamp_ms = common::TimeUtil::TimeStampMS();
+  record.sid = context->req->sid();
+  record.query_len = query.size() < QueryLogRecord::kMaxQuerySize ?
+      query.size() : QueryLogRecord::kMaxQuerySize;
+  memcpy(record.query, query.data(), record.query_len);
+  record.cache_hit = context->cache_hit;
+  record.partial = context->partial;
+  record.total_num = context->resp->total_num();
+  record.result_num = context->resp->item_size();
+  for (int i = 0; i < kStatLog; ++i) {
+    record.stage_us[i] = context->stage_cost_ns[i] / 1000;
+  }
+  record.total_us = (context->stage_ns - context->begin_ns) / 1000;
+  for (const auto& result : context->results) {
+    if (record.top_num >= QueryLogRecord::kTopNum) {
+      break;
+    }
+    record.top_doc_ids[record.top_num++] = result.doc_id;
+  }
+  query_log->Append(&record);
   return true;
 }
 }  // end doc_server
@@ -1,49 +1,153 @@
 #pragma once
 
+#include <memory>
+#include <functional>
+#include <unordered_map>
 #include "server.pb.h"
+#include "top_k.h"
 #include "../../index/cpp/index.h"
+#include "../../common/lru_cache.hpp"
+#include "../../common/histogram.hpp"
+#include "../../common/thread_pool.hpp"
 
 namespace doc_server {
 
 typedef doc_server_proto::Request Request;
 typedef doc_server_proto::Response Response;
-typedef doc_index_proto::Weight Weight;
+typedef doc_server_proto::StatsResponse StatsResponse;
+typedef doc_server_proto::BatchRequest BatchRequest;
+typedef doc_server_proto::BatchResponse BatchResponse;
+typedef doc_index::PostingList PostingList;
+typedef doc_index::PostingCursor PostingCursor;
 typedef doc_index::Index Index;
+// 批量查询中多个请求共用的拉链, key 是查询词
+typedef std::unordered_map<std::string, PostingList> SharedLists;
+// 查询结果缓存, key 见 DocSearcher::LookupCache
+typedef common::ShardedLruCache<std::string, std::shared_ptr<const Response> > ResultCache;
+
+// 响应中的错误码
+enum ErrCode {
+  kErrOk = 0,
+  kErrOverload = 1,  // 排队太久或者队列已满, 请求没有被处理
+};
+
+// 统计项. 前面是各个阶段的耗时(纳秒), 后面是每个查询的数量
+enum Stat {
+  kStatCutQuery = 0,
+  kStatCache,
+  kStatRetrieve,
+  kStatRank,
+  kStatPackage,
+  kStatLog,
+  kStatTotal,
+  kStatQueue,                      // 在线程池中排队的耗时
+  kStatTimeEnd,
+  kStatPostingNum = kStatTimeEnd,  // 触发的拉链长度之和
+  kStatResultNum,                  // 返回的结果数
+  kStatNum,
+};
 
 // 请求的上下文信息
 struct Context {
   const Request* req;
   Response* resp;
+  // 本次查询使用的索引版本, 查询过程中即使重新加载了索引也不会变
+  doc_index::IndexSnapshotPtr index;
   // 保存分词结果
   std::vector<std::string> words;
-  // 保存触发出的倒排拉链的结果集合
-  std::vector<const Weight*> all_query_chain;
+  // 整理之后的分页参数
+  int32_t offset;
+  int32_t limit;
+  // 结果缓存的 key, 以及是否命中了缓存
+  std::string cache_key;
+  bool cache_hit;
+  // 批量查询时多个请求共用的拉链, 不是批量查询时为 NULL
+  const SharedLists* shared_lists;
+  // 保存触发出的倒排拉链, 每个查询词一条
+  std::vector<PostingList> lists;
+  // 命中的文档总数
+  int32_t total_num;
+  // 触发的拉链长度之和
+  uint64_t posting_num;
+  // 处理的截止时间(单调时钟, 纳秒), 0 表示不限制. 超时之后结果不完整, partial 为 true
+  int64_t deadline_ns;
+  bool partial;
+  // 查询开始的时间, 以及当前阶段开始的时间(单调时钟, 纳秒)
+  int64_t begin_ns;
+  int64_t stage_ns;
+  // 已经结束的各个阶段的耗时(纳秒)
+  int64_t stage_cost_ns[kStatTimeEnd];
+  // 排序后需要返回的结果, 已经去掉了 offset 之前的部分
+  std::vector<ScoredDoc> results;
 
   Context(const Request* request, Response* response)
-    : req(request), resp(response) {  }
+    : req(request), resp(response), offset(0), limit(0),
+      cache_hit(false), shared_lists(NULL), total_num(0), posting_num(0),
+      deadline_ns(0), partial(false), begin_ns(0), stage_ns(0), stage_cost_ns() {  }
 };
 
 // 这个类是完成搜索的核心类
 class DocSearcher {
 public:
-  // 搜索流程的入口函数
-  bool Search(const Request& req, Response* resp);
+  // 搜索流程的入口函数. queue_ns 是请求在线程池中排队的耗时,
+  // 超过 --max_queue_ms 时不再处理, 直接返回 kErrOverload
+  bool Search(const Request& req, Response* resp, int64_t queue_ns = 0);
+  // 不处理请求, 直接返回 kErrOverload
+  static void Reject(const Request& req, Response* resp);
+  // 批量查询. 先在当前线程中给所有请求分词, 多个请求共用的查询词的拉链只解码一次,
+  // 然后在 pool 中并行处理这些请求, 响应和请求的顺序一致. 全部处理完之后调用 done,
+  // 调用 done 的可能是 pool 中的线程, 也可能是当前线程
+  static void SearchBatch(const BatchRequest& req, BatchResponse* resp, int64_t queue_ns,
+                          common::WorkStealingPool* pool, std::function<void()> done);
+  // 搜索流程分成两步, 批量查询时两步之间要处理共用的拉链.
+  // Prepare 负责分词和查缓存, Finish 负责剩下的步骤.
+  // queue_ns 是请求排队的耗时, 截止时间从收到请求开始计算
+  void Prepare(Context* context, int64_t queue_ns);
+  void Finish(Context* context);
+
+  // 结果缓存的命中和未命中次数
+  static uint64_t CacheHits();
+  static uint64_t CacheMisses();
+  // 重新加载索引之后调用, 释放旧版本的结果占用的内存
+  static void ClearCache();
+  // 各个阶段耗时的分位数等统计信息
+  static void GetStats(StatsResponse* resp);
 
 private:
   // 对查询词进行分词
   bool CutQuery(Context* context);
+  // 记录当前阶段的耗时, 并开始计时下一个阶段
+  void EndStage(Stat stat, Context* context);
+  static common::HistogramSet* GetHistograms();
+  // 查询结果缓存, 命中时直接填好响应
+  bool LookupCache(Context* context);
+  void UpdateCache(Context* context);
+  static ResultCache* GetCache();
+  // 查找查询词的拉链, 批量查询时优先使用共用的拉链
+  static bool FindList(const Context& context, const std::string& word, PostingList* list);
+  // 是否已经超过了截止时间, 超过时设置 partial
+  static bool Expired(Context* context);
   // 根据查询词结果进行触发
   bool Retrieve(Context* context);
   // 根据触发的结果进行排序
   bool Rank(Context* context);
   // 根据排序的结构拼装成响应
   bool PackageResponse(Context* context);
-  // 打印请求日志
+  // 单个查询词时直接从按照 weight 排好序的拉链中取出这一页, 取不到时返回 false
+  bool RankSingleTerm(const PostingList& list, int32_t offset, int32_t limit, Context* context);
+  // 遍历所有拉链计算得分, 返回命中的文档数
+  int32_t RankExhaustive(Context* context, std::vector<PostingCursor>* cursors, TopK* top_k);
+  // 使用 WAND / Block-Max WAND 跳过不可能进入结果的文档
+  void RankWand(Context* context, bool block_max, std::vector<PostingCursor>* cursors,
+                TopK* top_k);
+  // 去掉已经遍历完的拉链, 剩下的按照当前 doc_id 升序排列
+  static void SortCursors(std::vector<PostingCursor*>* sorted);
+  // 计算所有拉链在 doc_id 上的得分, 并把这些拉链移到下一个位置
+  static void ScoreDoc(uint32_t doc_id, std::vector<PostingCursor>* cursors, ScoredDoc* doc);
+  // 抽样记录查询日志, 只把记录放入队列, 由后台线程写文件
   bool Log(Context* context);
-  // 排序需要的比较函数
-  static bool CmpWeightPtr(const Weight* w1, const Weight* w2);
   // 生成描述信息
-  std::string GenDesc(int first_pos, const std::string& content);
+  std::string GenDesc(int first_pos, boost::string_ref content);
   // 替换 html 中的转义字符
   void ReplaceEscape(std::string* desc);
 };
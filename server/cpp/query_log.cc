@@ -0,0 +1,114 @@
+#include "query_log.h"
+#include <random>
+#include <chrono>
+#include <base/base.h>
+
+DEFINE_string(query_log_path, "./query_log", "查询日志的路径, 为空时不记录查询日志");
+DEFINE_double(query_log_sample_rate, 0.1, "查询日志的抽样比例, 取值 [0, 1]");
+DEFINE_int32(query_log_buffer_size, 16384, "查询日志队列的长度, 队列满时丢弃新的日志");
+
+namespace doc_server {
+
+bool QueryLog::Start() {
+  if (running_ || FLAGS_query_log_path.empty()) {
+    return true;
+  }
+  file_ = fopen(FLAGS_query_log_path.c_str(), "a");
+  if (file_ == NULL) {
+    LOG(ERROR) << "open query log failed! path=" << FLAGS_query_log_path;
+    return false;
+  }
+  queue_.reset(new common::RingBuffer<QueryLogRecord>(
+      std::max(FLAGS_query_log_buffer_size, 1)));
+  running_ = true;
+  writer_ = std::thread(&QueryLog::WriteLoop, this);
+  return true;
+}
+
+void QueryLog::Stop() {
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  writer_.join();
+  fclose(file_);
+  file_ = NULL;
+}
+
+bool QueryLog::Sample() {
+  if (!running_ || FLAGS_query_log_sample_rate <= 0) {
+    return false;
+  }
+  // 每个线程一个随机数生成器, 不需要加锁
+  thread_local std::minstd_rand rng(
+      std::hash<std::thread::id>()(std::this_thread::get_id()));
+  thread_local std::uniform_real_distribution<double> dist(0.0, 1.0);
+  return dist(rng) < FLAGS_query_log_sample_rate;
+}
+
+void QueryLog::Append(QueryLogRecord* record) {
+  if (!queue_->TryPush(*record)) {
+    ++dropped_;
+  }
+}
+
+void QueryLog::WriteLoop() {
+  QueryLogRecord record;
+  std::string line;
+  uint64_t reported = 0;
+  while (true) {
+    // 先取 running_ 再取队列, 退出前能把 Stop 之前放入的记录都写完
+    const bool running = running_;
+    bool written = false;
+    while (queue_->TryPop(&record)) {
+      Format(record, &line);
+      fwrite(line.data(), 1, line.size(), file_);
+      written = true;
+    }
+    if (written) {
+      fflush(file_);
+    }
+    if (!running) {
+      break;
+    }
+    if (dropped_ != reported) {
+      reported = dropped_;
+      LOG(WARNING) << "query log queue is full, dropped=" << reported;
+    }
+    // 队列空了就睡一会儿, 查询线程不需要唤醒这个线程
+    if (!written) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+}
+
+void QueryLog::Format(const QueryLogRecord& record, std::string* line) {
+  line->clear();
+  line->append(std::to_string(record.timestamp_ms)).push_back('\t');
+  line->append(std::to_string(record.sid)).push_back('\t');
+  line->push_back(record.cache_hit ? '1' : '0');
+  line->push_back('\t');
+  line->push_back(record.partial ? '1' : '0');
+  line->push_back('\t');
+  line->append(std::to_string(record.total_num)).push_back('\t');
+  line->append(std::to_string(record.result_num)).push_back('\t');
+  for (int i = 0; i < kStatLog; ++i) {
+    line->append(std::to_string(record.stage_us[i])).push_back(',');
+  }
+  line->append(std::to_string(record.total_us)).push_back('\t');
+  for (int i = 0; i < record.top_num; ++i) {
+    if (i > 0) {
+      line->push_back(',');
+    }
+    line->append(std::to_string(record.top_doc_ids[i]));
+  }
+  line->push_back('\t');
+  // 查询词中的分隔符换成空格, 保证一条记录只占一行
+  for (uint32_t i = 0; i < record.query_len; ++i) {
+    const char c = record.query[i];
+    line->push_back(c == '\t' || c == '\n' || c == '\r' ? ' ' : c);
+  }
+  line->push_back('\n');
+}
+
+}  // end doc_server
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include "doc_searcher.h"
+#include "../../common/ring_buffer.hpp"
+
+namespace doc_server {
+
+// 一条查询日志. 只保存定长的几个字段(查询词也截断后放在定长的数组中),
+// 放进队列和取出来都只是一次内存拷贝, 不会在查询线程中分配内存.
+// 格式化和写文件都在后台线程中完成
+struct QueryLogRecord {
+  // 最多记录前几个结果的 doc_id, 以及查询词的最大长度
+  static const int kTopNum = 10;
+  static const size_t kMaxQuerySize = 256;
+
+  int64_t timestamp_ms;
+  uint64_t sid;
+  char query[kMaxQuerySize];
+  uint32_t query_len;
+  bool cache_hit;
+  bool partial;
+  int32_t total_num;
+  int32_t result_num;
+  // 各个阶段的耗时(微秒), 到打日志之前为止
+  uint32_t stage_us[kStatLog];
+  uint32_t total_us;
+  // 命中缓存时没有 doc_id, top_num 为 0
+  int32_t top_num;
+  uint32_t top_doc_ids[kTopNum];
+
+  QueryLogRecord() : timestamp_ms(0), sid(0), query_len(0), cache_hit(false), partial(false),
+                     total_num(0), result_num(0), stage_us(), total_us(0), top_num(0),
+                     top_doc_ids() {}
+};
+
+static_assert(std::is_trivially_copyable<QueryLogRecord>::value,
+              "QueryLogRecord is copied into the ring buffer");
+
+// 异步的查询日志.
+// a) 查询线程按照 --query_log_sample_rate 抽样, 把记录放进无锁的环形队列,
+//    队列满时直接丢弃这条记录, 不会阻塞查询线程
+// b) 后台线程从队列中取出记录, 格式化成一行写到 --query_log_path 中,
+//    字段之间用 \t 分隔, 依次是: 毫秒时间戳, sid, 是否命中缓存, 是否超时(partial),
+//    命中的文档总数, 返回的结果数, 各阶段耗时(cut_query,cache,retrieve,rank,package,total 微秒),
+//    前几个结果的 doc_id(逗号分隔), 查询词
+class QueryLog {
+public:
+  static QueryLog* Instance() {
+    static QueryLog inst;
+    return &inst;
+  }
+
+  // 打开日志文件并启动后台线程. --query_log_path 为空时不记录日志
+  bool Start();
+  // 写完队列中剩下的记录之后停止后台线程
+  void Stop();
+
+  // 本次查询是否需要记录, 没有启动时总是返回 false
+  bool Sample();
+  // 把 record 拷贝进队列, 队列满时丢弃
+  void Append(QueryLogRecord* record);
+
+  uint64_t dropped() const { return dropped_; }
+
+private:
+  QueryLog() : file_(NULL), running_(false), dropped_(0) {}
+  ~QueryLog() { Stop(); }
+
+  void WriteLoop();
+  static void Format(const QueryLogRecord& record, std::string* line);
+
+  std::unique_ptr<common::RingBuffer<QueryLogRecord> > queue_;
+  FILE* file_;
+  std::thread writer_;
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> dropped_;
+};
+
+}  // end doc_server
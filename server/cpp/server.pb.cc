@@ -1,1548 +0,0 @@
-// Generated by the protocol buffer compiler.  DO NOT EDIT!
-// source: server.proto
-
-#include "server.pb.h"
-
-#include <algorithm>
-
-#include <google/protobuf/stubs/common.h>
-#include <google/protobuf/stubs/port.h>
-#include <google/protobuf/stubs/once.h>
-#include <google/protobuf/io/coded_stream.h>
-#include <google/protobuf/wire_format_lite_inl.h>
-#include <google/protobuf/descriptor.h>
-#include <google/protobuf/generated_message_reflection.h>
-#include <google/protobuf/reflection_ops.h>
-#include <google/protobuf/wire_format.h>
-// This is a temporary google only hack
-#ifdef GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-#include "third_party/protobuf/version.h"
-#endif
-// @@protoc_insertion_point(includes)
-namespace doc_server_proto {
-class RequestDefaultTypeInternal {
- public:
-  ::google::protobuf::internal::ExplicitlyConstructed<Request>
-      _instance;
-} _Request_default_instance_;
-class ItemDefaultTypeInternal {
- public:
-  ::google::protobuf::internal::ExplicitlyConstructed<Item>
-      _instance;
-} _Item_default_instance_;
-class ResponseDefaultTypeInternal {
- public:
-  ::google::protobuf::internal::ExplicitlyConstructed<Response>
-      _instance;
-} _Response_default_instance_;
-}  // namespace doc_server_proto
-namespace protobuf_server_2eproto {
-void InitDefaultsRequestImpl() {
-  GOOGLE_PROTOBUF_VERIFY_VERSION;
-
-#ifdef GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-  ::google::protobuf::internal::InitProtobufDefaultsForceUnique();
-#else
-  ::google::protobuf::internal::InitProtobufDefaults();
-#endif  // GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-  {
-    void* ptr = &::doc_server_proto::_Request_default_instance_;
-    new (ptr) ::doc_server_proto::Request();
-    ::google::protobuf::internal::OnShutdownDestroyMessage(ptr);
-  }
-  ::doc_server_proto::Request::InitAsDefaultInstance();
-}
-
-void InitDefaultsRequest() {
-  static GOOGLE_PROTOBUF_DECLARE_ONCE(once);
-  ::google::protobuf::GoogleOnceInit(&once, &InitDefaultsRequestImpl);
-}
-
-void InitDefaultsItemImpl() {
-  GOOGLE_PROTOBUF_VERIFY_VERSION;
-
-#ifdef GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-  ::google::protobuf::internal::InitProtobufDefaultsForceUnique();
-#else
-  ::google::protobuf::internal::InitProtobufDefaults();
-#endif  // GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-  {
-    void* ptr = &::doc_server_proto::_Item_default_instance_;
-    new (ptr) ::doc_server_proto::Item();
-    ::google::protobuf::internal::OnShutdownDestroyMessage(ptr);
-  }
-  ::doc_server_proto::Item::InitAsDefaultInstance();
-}
-
-void InitDefaultsItem() {
-  static GOOGLE_PROTOBUF_DECLARE_ONCE(once);
-  ::google::protobuf::GoogleOnceInit(&once, &InitDefaultsItemImpl);
-}
-
-void InitDefaultsResponseImpl() {
-  GOOGLE_PROTOBUF_VERIFY_VERSION;
-
-#ifdef GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-  ::google::protobuf::internal::InitProtobufDefaultsForceUnique();
-#else
-  ::google::protobuf::internal::InitProtobufDefaults();
-#endif  // GOOGLE_PROTOBUF_ENFORCE_UNIQUENESS
-  protobuf_server_2eproto::InitDefaultsItem();
-  {
-    void* ptr = &::doc_server_proto::_Response_default_instance_;
-    new (ptr) ::doc_server_proto::Response();
-    ::google::protobuf::internal::OnShutdownDestroyMessage(ptr);
-  }
-  ::doc_server_proto::Response::InitAsDefaultInstance();
-}
-
-void InitDefaultsResponse() {
-  static GOOGLE_PROTOBUF_DECLARE_ONCE(once);
-  ::google::protobuf::GoogleOnceInit(&once, &InitDefaultsResponseImpl);
-}
-
-::google::protobuf::Metadata file_level_metadata[3];
-const ::google::protobuf::ServiceDescriptor* file_level_service_descriptors[1];
-
-const ::google::protobuf::uint32 TableStruct::offsets[] GOOGLE_PROTOBUF_ATTRIBUTE_SECTION_VARIABLE(protodesc_cold) = {
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Request, _has_bits_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Request, _internal_metadata_),
-  ~0u,  // no _extensions_
-  ~0u,  // no _oneof_case_
-  ~0u,  // no _weak_field_map_
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Request, sid_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Request, timestamp_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Request, query_),
-  1,
-  2,
-  0,
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Item, _has_bits_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Item, _internal_metadata_),
-  ~0u,  // no _extensions_
-  ~0u,  // no _oneof_case_
-  ~0u,  // no _weak_field_map_
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Item, title_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Item, desc_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Item, show_url_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Item, jump_url_),
-  0,
-  1,
-  2,
-  3,
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Response, _has_bits_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Response, _internal_metadata_),
-  ~0u,  // no _extensions_
-  ~0u,  // no _oneof_case_
-  ~0u,  // no _weak_field_map_
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Response, sid_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Response, timestamp_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Response, item_),
-  GOOGLE_PROTOBUF_GENERATED_MESSAGE_FIELD_OFFSET(::doc_server_proto::Response, err_code_),
-  0,
-  1,
-  ~0u,
-  2,
-};
-static const ::google::protobuf::internal::MigrationSchema schemas[] GOOGLE_PROTOBUF_ATTRIBUTE_SECTION_VARIABLE(protodesc_cold) = {
-  { 0, 8, sizeof(::doc_server_proto::Request)},
-  { 11, 20, sizeof(::doc_server_proto::Item)},
-  { 24, 33, sizeof(::doc_server_proto::Response)},
-};
-
-static ::google::protobuf::Message const * const file_default_instances[] = {
-  reinterpret_cast<const ::google::protobuf::Message*>(&::doc_server_proto::_Request_default_instance_),
-  reinterpret_cast<const ::google::protobuf::Message*>(&::doc_server_proto::_Item_default_instance_),
-  reinterpret_cast<const ::google::protobuf::Message*>(&::doc_server_proto::_Response_default_instance_),
-};
-
-void protobuf_AssignDescriptors() {
-  AddDescriptors();
-  ::google::protobuf::MessageFactory* factory = NULL;
-  AssignDescriptors(
-      "server.proto", schemas, file_default_instances, TableStruct::offsets, factory,
-      file_level_metadata, NULL, file_level_service_descriptors);
-}
-
-void protobuf_AssignDescriptorsOnce() {
-  static GOOGLE_PROTOBUF_DECLARE_ONCE(once);
-  ::google::protobuf::GoogleOnceInit(&once, &protobuf_AssignDescriptors);
-}
-
-void protobuf_RegisterTypes(const ::std::string&) GOOGLE_PROTOBUF_ATTRIBUTE_COLD;
-void protobuf_RegisterTypes(const ::std::string&) {
-  protobuf_AssignDescriptorsOnce();
-  ::google::protobuf::internal::RegisterAllTypes(file_level_metadata, 3);
-}
-
-void AddDescriptorsImpl() {
-  InitDefaults();
-  static const char descriptor[] GOOGLE_PROTOBUF_ATTRIBUTE_SECTION_VARIABLE(protodesc_cold) = {
-      "\n\014server.proto\022\020doc_server_proto\"8\n\007Requ"
-      "est\022\013\n\003sid\030\001 \002(\004\022\021\n\ttimestamp\030\002 \002(\003\022\r\n\005q"
-      "uery\030\003 \002(\t\"G\n\004Item\022\r\n\005title\030\001 \002(\t\022\014\n\004des"
-      "c\030\002 \002(\t\022\020\n\010show_url\030\003 \002(\t\022\020\n\010jump_url\030\004 "
-      "\002(\t\"b\n\010Response\022\013\n\003sid\030\001 \002(\004\022\021\n\ttimestam"
-      "p\030\002 \002(\003\022$\n\004item\030\003 \003(\0132\026.doc_server_proto"
-      ".Item\022\020\n\010err_code\030\004 \001(\0052O\n\014DocServerAPI\022"
-      "\?\n\006Search\022\031.doc_server_proto.Request\032\032.d"
-      "oc_server_proto.ResponseB\003\200\001\001"
-  };
-  ::google::protobuf::DescriptorPool::InternalAddGeneratedFile(
-      descriptor, 349);
-  ::google::protobuf::MessageFactory::InternalRegisterGeneratedFile(
-    "server.proto", &protobuf_RegisterTypes);
-}
-
-void AddDescriptors() {
-  static GOOGLE_PROTOBUF_DECLARE_ONCE(once);
-  ::google::protobuf::GoogleOnceInit(&once, &AddDescriptorsImpl);
-}
-// Force AddDescriptors() to be called at dynamic initialization time.
-struct StaticDescriptorInitializer {
-  StaticDescriptorInitializer() {
-    AddDescriptors();
-  }
-} static_descriptor_initializer;
-}  // namespace protobuf_server_2eproto
-namespace doc_server_proto {
-
-// ===================================================================
-
-void Request::InitAsDefaultInstance() {
-}
-#if !defined(_MSC_VER) || _MSC_VER >= 1900
-const int Request::kSidFieldNumber;
-const int Request::kTimestampFieldNumber;
-const int Request::kQueryFieldNumber;
-#endif  // !defined(_MSC_VER) || _MSC_VER >= 1900
-
-Request::Request()
-  : ::google::protobuf::Message(), _internal_metadata_(NULL) {
-  if (GOOGLE_PREDICT_TRUE(this != internal_default_instance())) {
-    ::protobuf_server_2eproto::InitDefaultsRequest();
-  }
-  SharedCtor();
-  // @@protoc_insertion_point(constructor:doc_server_proto.Request)
-}
-Request::Request(const Request& from)
-  : ::google::protobuf::Message(),
-      _internal_metadata_(NULL),
-      _has_bits_(from._has_bits_),
-      _cached_size_(0) {
-  _internal_metadata_.MergeFrom(from._internal_metadata_);
-  query_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  if (from.has_query()) {
-    query_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.query_);
-  }
-  ::memcpy(&sid_, &from.sid_,
-    static_cast<size_t>(reinterpret_cast<char*>(&timestamp_) -
-    reinterpret_cast<char*>(&sid_)) + sizeof(timestamp_));
-  // @@protoc_insertion_point(copy_constructor:doc_server_proto.Request)
-}
-
-void Request::SharedCtor() {
-  _cached_size_ = 0;
-  query_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  ::memset(&sid_, 0, static_cast<size_t>(
-      reinterpret_cast<char*>(&timestamp_) -
-      reinterpret_cast<char*>(&sid_)) + sizeof(timestamp_));
-}
-
-Request::~Request() {
-  // @@protoc_insertion_point(destructor:doc_server_proto.Request)
-  SharedDtor();
-}
-
-void Request::SharedDtor() {
-  query_.DestroyNoArena(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-}
-
-void Request::SetCachedSize(int size) const {
-  GOOGLE_SAFE_CONCURRENT_WRITES_BEGIN();
-  _cached_size_ = size;
-  GOOGLE_SAFE_CONCURRENT_WRITES_END();
-}
-const ::google::protobuf::Descriptor* Request::descriptor() {
-  ::protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return ::protobuf_server_2eproto::file_level_metadata[kIndexInFileMessages].descriptor;
-}
-
-const Request& Request::default_instance() {
-  ::protobuf_server_2eproto::InitDefaultsRequest();
-  return *internal_default_instance();
-}
-
-Request* Request::New(::google::protobuf::Arena* arena) const {
-  Request* n = new Request;
-  if (arena != NULL) {
-    arena->Own(n);
-  }
-  return n;
-}
-
-void Request::Clear() {
-// @@protoc_insertion_point(message_clear_start:doc_server_proto.Request)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  // Prevent compiler warnings about cached_has_bits being unused
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  if (cached_has_bits & 0x00000001u) {
-    GOOGLE_DCHECK(!query_.IsDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited()));
-    (*query_.UnsafeRawStringPointer())->clear();
-  }
-  if (cached_has_bits & 6u) {
-    ::memset(&sid_, 0, static_cast<size_t>(
-        reinterpret_cast<char*>(&timestamp_) -
-        reinterpret_cast<char*>(&sid_)) + sizeof(timestamp_));
-  }
-  _has_bits_.Clear();
-  _internal_metadata_.Clear();
-}
-
-bool Request::MergePartialFromCodedStream(
-    ::google::protobuf::io::CodedInputStream* input) {
-#define DO_(EXPRESSION) if (!GOOGLE_PREDICT_TRUE(EXPRESSION)) goto failure
-  ::google::protobuf::uint32 tag;
-  // @@protoc_insertion_point(parse_start:doc_server_proto.Request)
-  for (;;) {
-    ::std::pair< ::google::protobuf::uint32, bool> p = input->ReadTagWithCutoffNoLastTag(127u);
-    tag = p.first;
-    if (!p.second) goto handle_unusual;
-    switch (::google::protobuf::internal::WireFormatLite::GetTagFieldNumber(tag)) {
-      // required uint64 sid = 1;
-      case 1: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(8u /* 8 & 0xFF */)) {
-          set_has_sid();
-          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
-                   ::google::protobuf::uint64, ::google::protobuf::internal::WireFormatLite::TYPE_UINT64>(
-                 input, &sid_)));
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // required int64 timestamp = 2;
-      case 2: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(16u /* 16 & 0xFF */)) {
-          set_has_timestamp();
-          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
-                   ::google::protobuf::int64, ::google::protobuf::internal::WireFormatLite::TYPE_INT64>(
-                 input, &timestamp_)));
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // required string query = 3;
-      case 3: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(26u /* 26 & 0xFF */)) {
-          DO_(::google::protobuf::internal::WireFormatLite::ReadString(
-                input, this->mutable_query()));
-          ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-            this->query().data(), static_cast<int>(this->query().length()),
-            ::google::protobuf::internal::WireFormat::PARSE,
-            "doc_server_proto.Request.query");
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      default: {
-      handle_unusual:
-        if (tag == 0) {
-          goto success;
-        }
-        DO_(::google::protobuf::internal::WireFormat::SkipField(
-              input, tag, _internal_metadata_.mutable_unknown_fields()));
-        break;
-      }
-    }
-  }
-success:
-  // @@protoc_insertion_point(parse_success:doc_server_proto.Request)
-  return true;
-failure:
-  // @@protoc_insertion_point(parse_failure:doc_server_proto.Request)
-  return false;
-#undef DO_
-}
-
-void Request::SerializeWithCachedSizes(
-    ::google::protobuf::io::CodedOutputStream* output) const {
-  // @@protoc_insertion_point(serialize_start:doc_server_proto.Request)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  // required uint64 sid = 1;
-  if (cached_has_bits & 0x00000002u) {
-    ::google::protobuf::internal::WireFormatLite::WriteUInt64(1, this->sid(), output);
-  }
-
-  // required int64 timestamp = 2;
-  if (cached_has_bits & 0x00000004u) {
-    ::google::protobuf::internal::WireFormatLite::WriteInt64(2, this->timestamp(), output);
-  }
-
-  // required string query = 3;
-  if (cached_has_bits & 0x00000001u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->query().data(), static_cast<int>(this->query().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Request.query");
-    ::google::protobuf::internal::WireFormatLite::WriteStringMaybeAliased(
-      3, this->query(), output);
-  }
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    ::google::protobuf::internal::WireFormat::SerializeUnknownFields(
-        _internal_metadata_.unknown_fields(), output);
-  }
-  // @@protoc_insertion_point(serialize_end:doc_server_proto.Request)
-}
-
-::google::protobuf::uint8* Request::InternalSerializeWithCachedSizesToArray(
-    bool deterministic, ::google::protobuf::uint8* target) const {
-  (void)deterministic; // Unused
-  // @@protoc_insertion_point(serialize_to_array_start:doc_server_proto.Request)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  // required uint64 sid = 1;
-  if (cached_has_bits & 0x00000002u) {
-    target = ::google::protobuf::internal::WireFormatLite::WriteUInt64ToArray(1, this->sid(), target);
-  }
-
-  // required int64 timestamp = 2;
-  if (cached_has_bits & 0x00000004u) {
-    target = ::google::protobuf::internal::WireFormatLite::WriteInt64ToArray(2, this->timestamp(), target);
-  }
-
-  // required string query = 3;
-  if (cached_has_bits & 0x00000001u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->query().data(), static_cast<int>(this->query().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Request.query");
-    target =
-      ::google::protobuf::internal::WireFormatLite::WriteStringToArray(
-        3, this->query(), target);
-  }
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    target = ::google::protobuf::internal::WireFormat::SerializeUnknownFieldsToArray(
-        _internal_metadata_.unknown_fields(), target);
-  }
-  // @@protoc_insertion_point(serialize_to_array_end:doc_server_proto.Request)
-  return target;
-}
-
-size_t Request::RequiredFieldsByteSizeFallback() const {
-// @@protoc_insertion_point(required_fields_byte_size_fallback_start:doc_server_proto.Request)
-  size_t total_size = 0;
-
-  if (has_query()) {
-    // required string query = 3;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->query());
-  }
-
-  if (has_sid()) {
-    // required uint64 sid = 1;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::UInt64Size(
-        this->sid());
-  }
-
-  if (has_timestamp()) {
-    // required int64 timestamp = 2;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::Int64Size(
-        this->timestamp());
-  }
-
-  return total_size;
-}
-size_t Request::ByteSizeLong() const {
-// @@protoc_insertion_point(message_byte_size_start:doc_server_proto.Request)
-  size_t total_size = 0;
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    total_size +=
-      ::google::protobuf::internal::WireFormat::ComputeUnknownFieldsSize(
-        _internal_metadata_.unknown_fields());
-  }
-  if (((_has_bits_[0] & 0x00000007) ^ 0x00000007) == 0) {  // All required fields are present.
-    // required string query = 3;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->query());
-
-    // required uint64 sid = 1;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::UInt64Size(
-        this->sid());
-
-    // required int64 timestamp = 2;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::Int64Size(
-        this->timestamp());
-
-  } else {
-    total_size += RequiredFieldsByteSizeFallback();
-  }
-  int cached_size = ::google::protobuf::internal::ToCachedSize(total_size);
-  GOOGLE_SAFE_CONCURRENT_WRITES_BEGIN();
-  _cached_size_ = cached_size;
-  GOOGLE_SAFE_CONCURRENT_WRITES_END();
-  return total_size;
-}
-
-void Request::MergeFrom(const ::google::protobuf::Message& from) {
-// @@protoc_insertion_point(generalized_merge_from_start:doc_server_proto.Request)
-  GOOGLE_DCHECK_NE(&from, this);
-  const Request* source =
-      ::google::protobuf::internal::DynamicCastToGenerated<const Request>(
-          &from);
-  if (source == NULL) {
-  // @@protoc_insertion_point(generalized_merge_from_cast_fail:doc_server_proto.Request)
-    ::google::protobuf::internal::ReflectionOps::Merge(from, this);
-  } else {
-  // @@protoc_insertion_point(generalized_merge_from_cast_success:doc_server_proto.Request)
-    MergeFrom(*source);
-  }
-}
-
-void Request::MergeFrom(const Request& from) {
-// @@protoc_insertion_point(class_specific_merge_from_start:doc_server_proto.Request)
-  GOOGLE_DCHECK_NE(&from, this);
-  _internal_metadata_.MergeFrom(from._internal_metadata_);
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = from._has_bits_[0];
-  if (cached_has_bits & 7u) {
-    if (cached_has_bits & 0x00000001u) {
-      set_has_query();
-      query_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.query_);
-    }
-    if (cached_has_bits & 0x00000002u) {
-      sid_ = from.sid_;
-    }
-    if (cached_has_bits & 0x00000004u) {
-      timestamp_ = from.timestamp_;
-    }
-    _has_bits_[0] |= cached_has_bits;
-  }
-}
-
-void Request::CopyFrom(const ::google::protobuf::Message& from) {
-// @@protoc_insertion_point(generalized_copy_from_start:doc_server_proto.Request)
-  if (&from == this) return;
-  Clear();
-  MergeFrom(from);
-}
-
-void Request::CopyFrom(const Request& from) {
-// @@protoc_insertion_point(class_specific_copy_from_start:doc_server_proto.Request)
-  if (&from == this) return;
-  Clear();
-  MergeFrom(from);
-}
-
-bool Request::IsInitialized() const {
-  if ((_has_bits_[0] & 0x00000007) != 0x00000007) return false;
-  return true;
-}
-
-void Request::Swap(Request* other) {
-  if (other == this) return;
-  InternalSwap(other);
-}
-void Request::InternalSwap(Request* other) {
-  using std::swap;
-  query_.Swap(&other->query_);
-  swap(sid_, other->sid_);
-  swap(timestamp_, other->timestamp_);
-  swap(_has_bits_[0], other->_has_bits_[0]);
-  _internal_metadata_.Swap(&other->_internal_metadata_);
-  swap(_cached_size_, other->_cached_size_);
-}
-
-::google::protobuf::Metadata Request::GetMetadata() const {
-  protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return ::protobuf_server_2eproto::file_level_metadata[kIndexInFileMessages];
-}
-
-
-// ===================================================================
-
-void Item::InitAsDefaultInstance() {
-}
-#if !defined(_MSC_VER) || _MSC_VER >= 1900
-const int Item::kTitleFieldNumber;
-const int Item::kDescFieldNumber;
-const int Item::kShowUrlFieldNumber;
-const int Item::kJumpUrlFieldNumber;
-#endif  // !defined(_MSC_VER) || _MSC_VER >= 1900
-
-Item::Item()
-  : ::google::protobuf::Message(), _internal_metadata_(NULL) {
-  if (GOOGLE_PREDICT_TRUE(this != internal_default_instance())) {
-    ::protobuf_server_2eproto::InitDefaultsItem();
-  }
-  SharedCtor();
-  // @@protoc_insertion_point(constructor:doc_server_proto.Item)
-}
-Item::Item(const Item& from)
-  : ::google::protobuf::Message(),
-      _internal_metadata_(NULL),
-      _has_bits_(from._has_bits_),
-      _cached_size_(0) {
-  _internal_metadata_.MergeFrom(from._internal_metadata_);
-  title_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  if (from.has_title()) {
-    title_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.title_);
-  }
-  desc_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  if (from.has_desc()) {
-    desc_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.desc_);
-  }
-  show_url_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  if (from.has_show_url()) {
-    show_url_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.show_url_);
-  }
-  jump_url_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  if (from.has_jump_url()) {
-    jump_url_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.jump_url_);
-  }
-  // @@protoc_insertion_point(copy_constructor:doc_server_proto.Item)
-}
-
-void Item::SharedCtor() {
-  _cached_size_ = 0;
-  title_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  desc_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  show_url_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  jump_url_.UnsafeSetDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-}
-
-Item::~Item() {
-  // @@protoc_insertion_point(destructor:doc_server_proto.Item)
-  SharedDtor();
-}
-
-void Item::SharedDtor() {
-  title_.DestroyNoArena(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  desc_.DestroyNoArena(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  show_url_.DestroyNoArena(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-  jump_url_.DestroyNoArena(&::google::protobuf::internal::GetEmptyStringAlreadyInited());
-}
-
-void Item::SetCachedSize(int size) const {
-  GOOGLE_SAFE_CONCURRENT_WRITES_BEGIN();
-  _cached_size_ = size;
-  GOOGLE_SAFE_CONCURRENT_WRITES_END();
-}
-const ::google::protobuf::Descriptor* Item::descriptor() {
-  ::protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return ::protobuf_server_2eproto::file_level_metadata[kIndexInFileMessages].descriptor;
-}
-
-const Item& Item::default_instance() {
-  ::protobuf_server_2eproto::InitDefaultsItem();
-  return *internal_default_instance();
-}
-
-Item* Item::New(::google::protobuf::Arena* arena) const {
-  Item* n = new Item;
-  if (arena != NULL) {
-    arena->Own(n);
-  }
-  return n;
-}
-
-void Item::Clear() {
-// @@protoc_insertion_point(message_clear_start:doc_server_proto.Item)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  // Prevent compiler warnings about cached_has_bits being unused
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  if (cached_has_bits & 15u) {
-    if (cached_has_bits & 0x00000001u) {
-      GOOGLE_DCHECK(!title_.IsDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited()));
-      (*title_.UnsafeRawStringPointer())->clear();
-    }
-    if (cached_has_bits & 0x00000002u) {
-      GOOGLE_DCHECK(!desc_.IsDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited()));
-      (*desc_.UnsafeRawStringPointer())->clear();
-    }
-    if (cached_has_bits & 0x00000004u) {
-      GOOGLE_DCHECK(!show_url_.IsDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited()));
-      (*show_url_.UnsafeRawStringPointer())->clear();
-    }
-    if (cached_has_bits & 0x00000008u) {
-      GOOGLE_DCHECK(!jump_url_.IsDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited()));
-      (*jump_url_.UnsafeRawStringPointer())->clear();
-    }
-  }
-  _has_bits_.Clear();
-  _internal_metadata_.Clear();
-}
-
-bool Item::MergePartialFromCodedStream(
-    ::google::protobuf::io::CodedInputStream* input) {
-#define DO_(EXPRESSION) if (!GOOGLE_PREDICT_TRUE(EXPRESSION)) goto failure
-  ::google::protobuf::uint32 tag;
-  // @@protoc_insertion_point(parse_start:doc_server_proto.Item)
-  for (;;) {
-    ::std::pair< ::google::protobuf::uint32, bool> p = input->ReadTagWithCutoffNoLastTag(127u);
-    tag = p.first;
-    if (!p.second) goto handle_unusual;
-    switch (::google::protobuf::internal::WireFormatLite::GetTagFieldNumber(tag)) {
-      // required string title = 1;
-      case 1: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(10u /* 10 & 0xFF */)) {
-          DO_(::google::protobuf::internal::WireFormatLite::ReadString(
-                input, this->mutable_title()));
-          ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-            this->title().data(), static_cast<int>(this->title().length()),
-            ::google::protobuf::internal::WireFormat::PARSE,
-            "doc_server_proto.Item.title");
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // required string desc = 2;
-      case 2: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(18u /* 18 & 0xFF */)) {
-          DO_(::google::protobuf::internal::WireFormatLite::ReadString(
-                input, this->mutable_desc()));
-          ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-            this->desc().data(), static_cast<int>(this->desc().length()),
-            ::google::protobuf::internal::WireFormat::PARSE,
-            "doc_server_proto.Item.desc");
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // required string show_url = 3;
-      case 3: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(26u /* 26 & 0xFF */)) {
-          DO_(::google::protobuf::internal::WireFormatLite::ReadString(
-                input, this->mutable_show_url()));
-          ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-            this->show_url().data(), static_cast<int>(this->show_url().length()),
-            ::google::protobuf::internal::WireFormat::PARSE,
-            "doc_server_proto.Item.show_url");
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // required string jump_url = 4;
-      case 4: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(34u /* 34 & 0xFF */)) {
-          DO_(::google::protobuf::internal::WireFormatLite::ReadString(
-                input, this->mutable_jump_url()));
-          ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-            this->jump_url().data(), static_cast<int>(this->jump_url().length()),
-            ::google::protobuf::internal::WireFormat::PARSE,
-            "doc_server_proto.Item.jump_url");
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      default: {
-      handle_unusual:
-        if (tag == 0) {
-          goto success;
-        }
-        DO_(::google::protobuf::internal::WireFormat::SkipField(
-              input, tag, _internal_metadata_.mutable_unknown_fields()));
-        break;
-      }
-    }
-  }
-success:
-  // @@protoc_insertion_point(parse_success:doc_server_proto.Item)
-  return true;
-failure:
-  // @@protoc_insertion_point(parse_failure:doc_server_proto.Item)
-  return false;
-#undef DO_
-}
-
-void Item::SerializeWithCachedSizes(
-    ::google::protobuf::io::CodedOutputStream* output) const {
-  // @@protoc_insertion_point(serialize_start:doc_server_proto.Item)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  // required string title = 1;
-  if (cached_has_bits & 0x00000001u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->title().data(), static_cast<int>(this->title().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.title");
-    ::google::protobuf::internal::WireFormatLite::WriteStringMaybeAliased(
-      1, this->title(), output);
-  }
-
-  // required string desc = 2;
-  if (cached_has_bits & 0x00000002u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->desc().data(), static_cast<int>(this->desc().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.desc");
-    ::google::protobuf::internal::WireFormatLite::WriteStringMaybeAliased(
-      2, this->desc(), output);
-  }
-
-  // required string show_url = 3;
-  if (cached_has_bits & 0x00000004u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->show_url().data(), static_cast<int>(this->show_url().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.show_url");
-    ::google::protobuf::internal::WireFormatLite::WriteStringMaybeAliased(
-      3, this->show_url(), output);
-  }
-
-  // required string jump_url = 4;
-  if (cached_has_bits & 0x00000008u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->jump_url().data(), static_cast<int>(this->jump_url().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.jump_url");
-    ::google::protobuf::internal::WireFormatLite::WriteStringMaybeAliased(
-      4, this->jump_url(), output);
-  }
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    ::google::protobuf::internal::WireFormat::SerializeUnknownFields(
-        _internal_metadata_.unknown_fields(), output);
-  }
-  // @@protoc_insertion_point(serialize_end:doc_server_proto.Item)
-}
-
-::google::protobuf::uint8* Item::InternalSerializeWithCachedSizesToArray(
-    bool deterministic, ::google::protobuf::uint8* target) const {
-  (void)deterministic; // Unused
-  // @@protoc_insertion_point(serialize_to_array_start:doc_server_proto.Item)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  // required string title = 1;
-  if (cached_has_bits & 0x00000001u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->title().data(), static_cast<int>(this->title().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.title");
-    target =
-      ::google::protobuf::internal::WireFormatLite::WriteStringToArray(
-        1, this->title(), target);
-  }
-
-  // required string desc = 2;
-  if (cached_has_bits & 0x00000002u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->desc().data(), static_cast<int>(this->desc().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.desc");
-    target =
-      ::google::protobuf::internal::WireFormatLite::WriteStringToArray(
-        2, this->desc(), target);
-  }
-
-  // required string show_url = 3;
-  if (cached_has_bits & 0x00000004u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->show_url().data(), static_cast<int>(this->show_url().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.show_url");
-    target =
-      ::google::protobuf::internal::WireFormatLite::WriteStringToArray(
-        3, this->show_url(), target);
-  }
-
-  // required string jump_url = 4;
-  if (cached_has_bits & 0x00000008u) {
-    ::google::protobuf::internal::WireFormat::VerifyUTF8StringNamedField(
-      this->jump_url().data(), static_cast<int>(this->jump_url().length()),
-      ::google::protobuf::internal::WireFormat::SERIALIZE,
-      "doc_server_proto.Item.jump_url");
-    target =
-      ::google::protobuf::internal::WireFormatLite::WriteStringToArray(
-        4, this->jump_url(), target);
-  }
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    target = ::google::protobuf::internal::WireFormat::SerializeUnknownFieldsToArray(
-        _internal_metadata_.unknown_fields(), target);
-  }
-  // @@protoc_insertion_point(serialize_to_array_end:doc_server_proto.Item)
-  return target;
-}
-
-size_t Item::RequiredFieldsByteSizeFallback() const {
-// @@protoc_insertion_point(required_fields_byte_size_fallback_start:doc_server_proto.Item)
-  size_t total_size = 0;
-
-  if (has_title()) {
-    // required string title = 1;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->title());
-  }
-
-  if (has_desc()) {
-    // required string desc = 2;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->desc());
-  }
-
-  if (has_show_url()) {
-    // required string show_url = 3;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->show_url());
-  }
-
-  if (has_jump_url()) {
-    // required string jump_url = 4;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->jump_url());
-  }
-
-  return total_size;
-}
-size_t Item::ByteSizeLong() const {
-// @@protoc_insertion_point(message_byte_size_start:doc_server_proto.Item)
-  size_t total_size = 0;
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    total_size +=
-      ::google::protobuf::internal::WireFormat::ComputeUnknownFieldsSize(
-        _internal_metadata_.unknown_fields());
-  }
-  if (((_has_bits_[0] & 0x0000000f) ^ 0x0000000f) == 0) {  // All required fields are present.
-    // required string title = 1;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->title());
-
-    // required string desc = 2;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->desc());
-
-    // required string show_url = 3;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->show_url());
-
-    // required string jump_url = 4;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::StringSize(
-        this->jump_url());
-
-  } else {
-    total_size += RequiredFieldsByteSizeFallback();
-  }
-  int cached_size = ::google::protobuf::internal::ToCachedSize(total_size);
-  GOOGLE_SAFE_CONCURRENT_WRITES_BEGIN();
-  _cached_size_ = cached_size;
-  GOOGLE_SAFE_CONCURRENT_WRITES_END();
-  return total_size;
-}
-
-void Item::MergeFrom(const ::google::protobuf::Message& from) {
-// @@protoc_insertion_point(generalized_merge_from_start:doc_server_proto.Item)
-  GOOGLE_DCHECK_NE(&from, this);
-  const Item* source =
-      ::google::protobuf::internal::DynamicCastToGenerated<const Item>(
-          &from);
-  if (source == NULL) {
-  // @@protoc_insertion_point(generalized_merge_from_cast_fail:doc_server_proto.Item)
-    ::google::protobuf::internal::ReflectionOps::Merge(from, this);
-  } else {
-  // @@protoc_insertion_point(generalized_merge_from_cast_success:doc_server_proto.Item)
-    MergeFrom(*source);
-  }
-}
-
-void Item::MergeFrom(const Item& from) {
-// @@protoc_insertion_point(class_specific_merge_from_start:doc_server_proto.Item)
-  GOOGLE_DCHECK_NE(&from, this);
-  _internal_metadata_.MergeFrom(from._internal_metadata_);
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = from._has_bits_[0];
-  if (cached_has_bits & 15u) {
-    if (cached_has_bits & 0x00000001u) {
-      set_has_title();
-      title_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.title_);
-    }
-    if (cached_has_bits & 0x00000002u) {
-      set_has_desc();
-      desc_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.desc_);
-    }
-    if (cached_has_bits & 0x00000004u) {
-      set_has_show_url();
-      show_url_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.show_url_);
-    }
-    if (cached_has_bits & 0x00000008u) {
-      set_has_jump_url();
-      jump_url_.AssignWithDefault(&::google::protobuf::internal::GetEmptyStringAlreadyInited(), from.jump_url_);
-    }
-  }
-}
-
-void Item::CopyFrom(const ::google::protobuf::Message& from) {
-// @@protoc_insertion_point(generalized_copy_from_start:doc_server_proto.Item)
-  if (&from == this) return;
-  Clear();
-  MergeFrom(from);
-}
-
-void Item::CopyFrom(const Item& from) {
-// @@protoc_insertion_point(class_specific_copy_from_start:doc_server_proto.Item)
-  if (&from == this) return;
-  Clear();
-  MergeFrom(from);
-}
-
-bool Item::IsInitialized() const {
-  if ((_has_bits_[0] & 0x0000000f) != 0x0000000f) return false;
-  return true;
-}
-
-void Item::Swap(Item* other) {
-  if (other == this) return;
-  InternalSwap(other);
-}
-void Item::InternalSwap(Item* other) {
-  using std::swap;
-  title_.Swap(&other->title_);
-  desc_.Swap(&other->desc_);
-  show_url_.Swap(&other->show_url_);
-  jump_url_.Swap(&other->jump_url_);
-  swap(_has_bits_[0], other->_has_bits_[0]);
-  _internal_metadata_.Swap(&other->_internal_metadata_);
-  swap(_cached_size_, other->_cached_size_);
-}
-
-::google::protobuf::Metadata Item::GetMetadata() const {
-  protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return ::protobuf_server_2eproto::file_level_metadata[kIndexInFileMessages];
-}
-
-
-// ===================================================================
-
-void Response::InitAsDefaultInstance() {
-}
-#if !defined(_MSC_VER) || _MSC_VER >= 1900
-const int Response::kSidFieldNumber;
-const int Response::kTimestampFieldNumber;
-const int Response::kItemFieldNumber;
-const int Response::kErrCodeFieldNumber;
-#endif  // !defined(_MSC_VER) || _MSC_VER >= 1900
-
-Response::Response()
-  : ::google::protobuf::Message(), _internal_metadata_(NULL) {
-  if (GOOGLE_PREDICT_TRUE(this != internal_default_instance())) {
-    ::protobuf_server_2eproto::InitDefaultsResponse();
-  }
-  SharedCtor();
-  // @@protoc_insertion_point(constructor:doc_server_proto.Response)
-}
-Response::Response(const Response& from)
-  : ::google::protobuf::Message(),
-      _internal_metadata_(NULL),
-      _has_bits_(from._has_bits_),
-      _cached_size_(0),
-      item_(from.item_) {
-  _internal_metadata_.MergeFrom(from._internal_metadata_);
-  ::memcpy(&sid_, &from.sid_,
-    static_cast<size_t>(reinterpret_cast<char*>(&err_code_) -
-    reinterpret_cast<char*>(&sid_)) + sizeof(err_code_));
-  // @@protoc_insertion_point(copy_constructor:doc_server_proto.Response)
-}
-
-void Response::SharedCtor() {
-  _cached_size_ = 0;
-  ::memset(&sid_, 0, static_cast<size_t>(
-      reinterpret_cast<char*>(&err_code_) -
-      reinterpret_cast<char*>(&sid_)) + sizeof(err_code_));
-}
-
-Response::~Response() {
-  // @@protoc_insertion_point(destructor:doc_server_proto.Response)
-  SharedDtor();
-}
-
-void Response::SharedDtor() {
-}
-
-void Response::SetCachedSize(int size) const {
-  GOOGLE_SAFE_CONCURRENT_WRITES_BEGIN();
-  _cached_size_ = size;
-  GOOGLE_SAFE_CONCURRENT_WRITES_END();
-}
-const ::google::protobuf::Descriptor* Response::descriptor() {
-  ::protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return ::protobuf_server_2eproto::file_level_metadata[kIndexInFileMessages].descriptor;
-}
-
-const Response& Response::default_instance() {
-  ::protobuf_server_2eproto::InitDefaultsResponse();
-  return *internal_default_instance();
-}
-
-Response* Response::New(::google::protobuf::Arena* arena) const {
-  Response* n = new Response;
-  if (arena != NULL) {
-    arena->Own(n);
-  }
-  return n;
-}
-
-void Response::Clear() {
-// @@protoc_insertion_point(message_clear_start:doc_server_proto.Response)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  // Prevent compiler warnings about cached_has_bits being unused
-  (void) cached_has_bits;
-
-  item_.Clear();
-  cached_has_bits = _has_bits_[0];
-  if (cached_has_bits & 7u) {
-    ::memset(&sid_, 0, static_cast<size_t>(
-        reinterpret_cast<char*>(&err_code_) -
-        reinterpret_cast<char*>(&sid_)) + sizeof(err_code_));
-  }
-  _has_bits_.Clear();
-  _internal_metadata_.Clear();
-}
-
-bool Response::MergePartialFromCodedStream(
-    ::google::protobuf::io::CodedInputStream* input) {
-#define DO_(EXPRESSION) if (!GOOGLE_PREDICT_TRUE(EXPRESSION)) goto failure
-  ::google::protobuf::uint32 tag;
-  // @@protoc_insertion_point(parse_start:doc_server_proto.Response)
-  for (;;) {
-    ::std::pair< ::google::protobuf::uint32, bool> p = input->ReadTagWithCutoffNoLastTag(127u);
-    tag = p.first;
-    if (!p.second) goto handle_unusual;
-    switch (::google::protobuf::internal::WireFormatLite::GetTagFieldNumber(tag)) {
-      // required uint64 sid = 1;
-      case 1: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(8u /* 8 & 0xFF */)) {
-          set_has_sid();
-          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
-                   ::google::protobuf::uint64, ::google::protobuf::internal::WireFormatLite::TYPE_UINT64>(
-                 input, &sid_)));
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // required int64 timestamp = 2;
-      case 2: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(16u /* 16 & 0xFF */)) {
-          set_has_timestamp();
-          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
-                   ::google::protobuf::int64, ::google::protobuf::internal::WireFormatLite::TYPE_INT64>(
-                 input, &timestamp_)));
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // repeated .doc_server_proto.Item item = 3;
-      case 3: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(26u /* 26 & 0xFF */)) {
-          DO_(::google::protobuf::internal::WireFormatLite::ReadMessage(input, add_item()));
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      // optional int32 err_code = 4;
-      case 4: {
-        if (static_cast< ::google::protobuf::uint8>(tag) ==
-            static_cast< ::google::protobuf::uint8>(32u /* 32 & 0xFF */)) {
-          set_has_err_code();
-          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
-                   ::google::protobuf::int32, ::google::protobuf::internal::WireFormatLite::TYPE_INT32>(
-                 input, &err_code_)));
-        } else {
-          goto handle_unusual;
-        }
-        break;
-      }
-
-      default: {
-      handle_unusual:
-        if (tag == 0) {
-          goto success;
-        }
-        DO_(::google::protobuf::internal::WireFormat::SkipField(
-              input, tag, _internal_metadata_.mutable_unknown_fields()));
-        break;
-      }
-    }
-  }
-success:
-  // @@protoc_insertion_point(parse_success:doc_server_proto.Response)
-  return true;
-failure:
-  // @@protoc_insertion_point(parse_failure:doc_server_proto.Response)
-  return false;
-#undef DO_
-}
-
-void Response::SerializeWithCachedSizes(
-    ::google::protobuf::io::CodedOutputStream* output) const {
-  // @@protoc_insertion_point(serialize_start:doc_server_proto.Response)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  // required uint64 sid = 1;
-  if (cached_has_bits & 0x00000001u) {
-    ::google::protobuf::internal::WireFormatLite::WriteUInt64(1, this->sid(), output);
-  }
-
-  // required int64 timestamp = 2;
-  if (cached_has_bits & 0x00000002u) {
-    ::google::protobuf::internal::WireFormatLite::WriteInt64(2, this->timestamp(), output);
-  }
-
-  // repeated .doc_server_proto.Item item = 3;
-  for (unsigned int i = 0,
-      n = static_cast<unsigned int>(this->item_size()); i < n; i++) {
-    ::google::protobuf::internal::WireFormatLite::WriteMessageMaybeToArray(
-      3, this->item(static_cast<int>(i)), output);
-  }
-
-  // optional int32 err_code = 4;
-  if (cached_has_bits & 0x00000004u) {
-    ::google::protobuf::internal::WireFormatLite::WriteInt32(4, this->err_code(), output);
-  }
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    ::google::protobuf::internal::WireFormat::SerializeUnknownFields(
-        _internal_metadata_.unknown_fields(), output);
-  }
-  // @@protoc_insertion_point(serialize_end:doc_server_proto.Response)
-}
-
-::google::protobuf::uint8* Response::InternalSerializeWithCachedSizesToArray(
-    bool deterministic, ::google::protobuf::uint8* target) const {
-  (void)deterministic; // Unused
-  // @@protoc_insertion_point(serialize_to_array_start:doc_server_proto.Response)
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  cached_has_bits = _has_bits_[0];
-  // required uint64 sid = 1;
-  if (cached_has_bits & 0x00000001u) {
-    target = ::google::protobuf::internal::WireFormatLite::WriteUInt64ToArray(1, this->sid(), target);
-  }
-
-  // required int64 timestamp = 2;
-  if (cached_has_bits & 0x00000002u) {
-    target = ::google::protobuf::internal::WireFormatLite::WriteInt64ToArray(2, this->timestamp(), target);
-  }
-
-  // repeated .doc_server_proto.Item item = 3;
-  for (unsigned int i = 0,
-      n = static_cast<unsigned int>(this->item_size()); i < n; i++) {
-    target = ::google::protobuf::internal::WireFormatLite::
-      InternalWriteMessageToArray(
-        3, this->item(static_cast<int>(i)), deterministic, target);
-  }
-
-  // optional int32 err_code = 4;
-  if (cached_has_bits & 0x00000004u) {
-    target = ::google::protobuf::internal::WireFormatLite::WriteInt32ToArray(4, this->err_code(), target);
-  }
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    target = ::google::protobuf::internal::WireFormat::SerializeUnknownFieldsToArray(
-        _internal_metadata_.unknown_fields(), target);
-  }
-  // @@protoc_insertion_point(serialize_to_array_end:doc_server_proto.Response)
-  return target;
-}
-
-size_t Response::RequiredFieldsByteSizeFallback() const {
-// @@protoc_insertion_point(required_fields_byte_size_fallback_start:doc_server_proto.Response)
-  size_t total_size = 0;
-
-  if (has_sid()) {
-    // required uint64 sid = 1;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::UInt64Size(
-        this->sid());
-  }
-
-  if (has_timestamp()) {
-    // required int64 timestamp = 2;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::Int64Size(
-        this->timestamp());
-  }
-
-  return total_size;
-}
-size_t Response::ByteSizeLong() const {
-// @@protoc_insertion_point(message_byte_size_start:doc_server_proto.Response)
-  size_t total_size = 0;
-
-  if (_internal_metadata_.have_unknown_fields()) {
-    total_size +=
-      ::google::protobuf::internal::WireFormat::ComputeUnknownFieldsSize(
-        _internal_metadata_.unknown_fields());
-  }
-  if (((_has_bits_[0] & 0x00000003) ^ 0x00000003) == 0) {  // All required fields are present.
-    // required uint64 sid = 1;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::UInt64Size(
-        this->sid());
-
-    // required int64 timestamp = 2;
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::Int64Size(
-        this->timestamp());
-
-  } else {
-    total_size += RequiredFieldsByteSizeFallback();
-  }
-  // repeated .doc_server_proto.Item item = 3;
-  {
-    unsigned int count = static_cast<unsigned int>(this->item_size());
-    total_size += 1UL * count;
-    for (unsigned int i = 0; i < count; i++) {
-      total_size +=
-        ::google::protobuf::internal::WireFormatLite::MessageSize(
-          this->item(static_cast<int>(i)));
-    }
-  }
-
-  // optional int32 err_code = 4;
-  if (has_err_code()) {
-    total_size += 1 +
-      ::google::protobuf::internal::WireFormatLite::Int32Size(
-        this->err_code());
-  }
-
-  int cached_size = ::google::protobuf::internal::ToCachedSize(total_size);
-  GOOGLE_SAFE_CONCURRENT_WRITES_BEGIN();
-  _cached_size_ = cached_size;
-  GOOGLE_SAFE_CONCURRENT_WRITES_END();
-  return total_size;
-}
-
-void Response::MergeFrom(const ::google::protobuf::Message& from) {
-// @@protoc_insertion_point(generalized_merge_from_start:doc_server_proto.Response)
-  GOOGLE_DCHECK_NE(&from, this);
-  const Response* source =
-      ::google::protobuf::internal::DynamicCastToGenerated<const Response>(
-          &from);
-  if (source == NULL) {
-  // @@protoc_insertion_point(generalized_merge_from_cast_fail:doc_server_proto.Response)
-    ::google::protobuf::internal::ReflectionOps::Merge(from, this);
-  } else {
-  // @@protoc_insertion_point(generalized_merge_from_cast_success:doc_server_proto.Response)
-    MergeFrom(*source);
-  }
-}
-
-void Response::MergeFrom(const Response& from) {
-// @@protoc_insertion_point(class_specific_merge_from_start:doc_server_proto.Response)
-  GOOGLE_DCHECK_NE(&from, this);
-  _internal_metadata_.MergeFrom(from._internal_metadata_);
-  ::google::protobuf::uint32 cached_has_bits = 0;
-  (void) cached_has_bits;
-
-  item_.MergeFrom(from.item_);
-  cached_has_bits = from._has_bits_[0];
-  if (cached_has_bits & 7u) {
-    if (cached_has_bits & 0x00000001u) {
-      sid_ = from.sid_;
-    }
-    if (cached_has_bits & 0x00000002u) {
-      timestamp_ = from.timestamp_;
-    }
-    if (cached_has_bits & 0x00000004u) {
-      err_code_ = from.err_code_;
-    }
-    _has_bits_[0] |= cached_has_bits;
-  }
-}
-
-void Response::CopyFrom(const ::google::protobuf::Message& from) {
-// @@protoc_insertion_point(generalized_copy_from_start:doc_server_proto.Response)
-  if (&from == this) return;
-  Clear();
-  MergeFrom(from);
-}
-
-void Response::CopyFrom(const Response& from) {
-// @@protoc_insertion_point(class_specific_copy_from_start:doc_server_proto.Response)
-  if (&from == this) return;
-  Clear();
-  MergeFrom(from);
-}
-
-bool Response::IsInitialized() const {
-  if ((_has_bits_[0] & 0x00000003) != 0x00000003) return false;
-  if (!::google::protobuf::internal::AllAreInitialized(this->item())) return false;
-  return true;
-}
-
-void Response::Swap(Response* other) {
-  if (other == this) return;
-  InternalSwap(other);
-}
-void Response::InternalSwap(Response* other) {
-  using std::swap;
-  item_.InternalSwap(&other->item_);
-  swap(sid_, other->sid_);
-  swap(timestamp_, other->timestamp_);
-  swap(err_code_, other->err_code_);
-  swap(_has_bits_[0], other->_has_bits_[0]);
-  _internal_metadata_.Swap(&other->_internal_metadata_);
-  swap(_cached_size_, other->_cached_size_);
-}
-
-::google::protobuf::Metadata Response::GetMetadata() const {
-  protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return ::protobuf_server_2eproto::file_level_metadata[kIndexInFileMessages];
-}
-
-
-// ===================================================================
-
-DocServerAPI::~DocServerAPI() {}
-
-const ::google::protobuf::ServiceDescriptor* DocServerAPI::descriptor() {
-  protobuf_server_2eproto::protobuf_AssignDescriptorsOnce();
-  return protobuf_server_2eproto::file_level_service_descriptors[0];
-}
-
-const ::google::protobuf::ServiceDescriptor* DocServerAPI::GetDescriptor() {
-  return descriptor();
-}
-
-void DocServerAPI::Search(::google::protobuf::RpcController* controller,
-                         const ::doc_server_proto::Request*,
-                         ::doc_server_proto::Response*,
-                         ::google::protobuf::Closure* done) {
-  controller->SetFailed("Method Search() not implemented.");
-  done->Run();
-}
-
-void DocServerAPI::CallMethod(const ::google::protobuf::MethodDescriptor* method,
-                             ::google::protobuf::RpcController* controller,
-                             const ::google::protobuf::Message* request,
-                             ::google::protobuf::Message* response,
-                             ::google::protobuf::Closure* done) {
-  GOOGLE_DCHECK_EQ(method->service(), protobuf_server_2eproto::file_level_service_descriptors[0]);
-  switch(method->index()) {
-    case 0:
-      Search(controller,
-             ::google::protobuf::down_cast<const ::doc_server_proto::Request*>(request),
-             ::google::protobuf::down_cast< ::doc_server_proto::Response*>(response),
-             done);
-      break;
-    default:
-      GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
-      break;
-  }
-}
-
-const ::google::protobuf::Message& DocServerAPI::GetRequestPrototype(
-    const ::google::protobuf::MethodDescriptor* method) const {
-  GOOGLE_DCHECK_EQ(method->service(), descriptor());
-  switch(method->index()) {
-    case 0:
-      return ::doc_server_proto::Request::default_instance();
-    default:
-      GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
-      return *::google::protobuf::MessageFactory::generated_factory()
-          ->GetPrototype(method->input_type());
-  }
-}
-
-const ::google::protobuf::Message& DocServerAPI::GetResponsePrototype(
-    const ::google::protobuf::MethodDescriptor* method) const {
-  GOOGLE_DCHECK_EQ(method->service(), descriptor());
-  switch(method->index()) {
-    case 0:
-      return ::doc_server_proto::Response::default_instance();
-    default:
-      GOOGLE_LOG(FATAL) << "Bad method index; this should never happen.";
-      return *::google::protobuf::MessageFactory::generated_factory()
-          ->GetPrototype(method->output_type());
-  }
-}
-
-DocServerAPI_Stub::DocServerAPI_Stub(::google::protobuf::RpcChannel* channel)
-  : channel_(channel), owns_channel_(false) {}
-DocServerAPI_Stub::DocServerAPI_Stub(
-    ::google::protobuf::RpcChannel* channel,
-    ::google::protobuf::Service::ChannelOwnership ownership)
-  : channel_(channel),
-    owns_channel_(ownership == ::google::protobuf::Service::STUB_OWNS_CHANNEL) {}
-DocServerAPI_Stub::~DocServerAPI_Stub() {
-  if (owns_channel_) delete channel_;
-}
-
-void DocServerAPI_Stub::Search(::google::protobuf::RpcController* controller,
-                              const ::doc_server_proto::Request* request,
-                              ::doc_server_proto::Response* response,
-                              ::google::protobuf::Closure* done) {
-  channel_->CallMethod(descriptor()->method(0),
-                       controller, request, response, done);
-}
-
-// @@protoc_insertion_point(namespace_scope)
-}  // namespace doc_server_proto
-
-// @@protoc_insertion_point(global_scope)
@@ -1,33 +1,179 @@
+#include <signal.h>
+#include <pthread.h>
+#include <functional>
+#include <thread>
+#include <vector>
 #include <base/base.h>
 #include <sofa/pbrpc/pbrpc.h>
 #include "../../common/util.hpp"
+#include "../../common/thread_pool.hpp"
+#include "../../common/blocking_queue.hpp"
 #include "server.pb.h"
 #include "doc_searcher.h"
+#include "query_log.h"
 
 DEFINE_string(port, "10000", "服务器端口号");
 DEFINE_string(index_path, "../index/index_file", "索引文件的路径");
+DEFINE_int32(work_thread_num, 4, "RPC 框架处理网络 IO 的线程数");
+DEFINE_int32(search_thread_num, 0, "处理查询的线程数, 0 表示和 CPU 核数相同");
+DEFINE_int32(search_queue_size, 1024, "等待处理的查询数的上限, 超过之后直接返回过载的错误码");
 
 namespace doc_server {
 
 typedef doc_server_proto::Request Request;
 typedef doc_server_proto::Response Response;
+typedef doc_server_proto::BatchRequest BatchRequest;
+typedef doc_server_proto::BatchResponse BatchResponse;
+typedef doc_server_proto::ReloadRequest ReloadRequest;
+typedef doc_server_proto::ReloadResponse ReloadResponse;
+typedef doc_server_proto::StatsRequest StatsRequest;
+typedef doc_server_proto::StatsResponse StatsResponse;
+
+// 一次重新加载索引的请求. index_path 为空时加载上一次加载的索引文件,
+// 加载完之后调用 done(是否成功, 当前索引的版本号)
+struct ReloadTask {
+  std::string index_path;
+  std::function<void(bool, uint64_t)> done;
+};
+
+// Reload RPC 和 SIGHUP 都只是把请求放进这个队列, 由 ReloadLoop 线程按顺序加载,
+// 加载索引很慢, 不能占住 RPC 框架的线程. 队列满时直接拒绝, 不会阻塞调用者
+common::BlockingQueue<ReloadTask>* ReloadQueue() {
+  static common::BlockingQueue<ReloadTask> queue(64);
+  return &queue;
+}
+
+// 新索引在这个线程中加载, 其他线程照常使用旧索引处理查询.
+// 只有这一个线程加载索引, last_path 不需要加锁.
+// 排队的请求中连续几个加载的是同一个文件时合并成一次加载, 都用这次的结果返回
+void ReloadLoop() {
+  std::string last_path = fLS::FLAGS_index_path;
+  doc_index::Index* index = doc_index::Index::Instance();
+  ReloadTask task;
+  bool has_task = ReloadQueue()->Pop(&task);
+  while (has_task) {
+    const std::string path = task.index_path.empty() ? last_path : task.index_path;
+    std::vector<ReloadTask> merged;
+    merged.push_back(std::move(task));
+    has_task = false;
+    while (ReloadQueue()->TryPop(&task)) {
+      if ((task.index_path.empty() ? last_path : task.index_path) != path) {
+        // 加载别的文件, 留到下一轮
+        has_task = true;
+        break;
+      }
+      merged.push_back(std::move(task));
+    }
+    bool ok = index->Load(path);
+    if (ok) {
+      last_path = path;
+      // 缓存的 key 中带有索引的版本号, 旧的结果不会再被命中, 此处只是释放内存
+      DocSearcher::ClearCache();
+    }
+    const uint64_t generation = index->GetSnapshot()->generation();
+    for (auto& merged_task : merged) {
+      merged_task.done(ok, generation);
+    }
+    if (!has_task) {
+      has_task = ReloadQueue()->Pop(&task);
+    }
+  }
+}
+
+// 收到 SIGHUP 时重新加载索引. 所有线程都屏蔽了 SIGHUP, 只有这个线程通过
+// sigwait 同步地接收, 不需要在信号处理函数中做任何事情
+void ReloadOnSignal(sigset_t signals) {
+  while (true) {
+    int sig = 0;
+    if (sigwait(&signals, &sig) != 0) {
+      continue;
+    }
+    LOG(INFO) << "receive signal " << sig << ", reload index";
+    ReloadTask task;
+    task.done = [](bool ok, uint64_t generation) {
+      LOG(INFO) << "reload index " << (ok ? "done" : "failed") << "! generation=" << generation;
+    };
+    if (!ReloadQueue()->TryPush(task)) {
+      LOG(WARNING) << "too many pending reloads, ignore signal " << sig;
+    }
+  }
+}
 
 class DocServerAPIImpl : public doc_server_proto::DocServerAPI {
 public:
-  // 此函数是真正在服务器端完成计算的函数
+  DocServerAPIImpl()
+    : search_pool_(fLI::FLAGS_search_thread_num > 0 ? fLI::FLAGS_search_thread_num
+                   : std::max(std::thread::hardware_concurrency(), 1u),
+                   fLI::FLAGS_search_queue_size) {
+    LOG(INFO) << "search thread num=" << search_pool_.thread_num();
+  }
+
+  // 此函数是真正在服务器端完成计算的函数.
+  // 查询放到单独的线程池中处理, 处理完之后在线程池中调用 done->Run(),
+  // RPC 框架的线程只负责收发数据, 不会被耗时长的查询占住
   void Search(::google::protobuf::RpcController* controller, const Request* req,
               Response* resp, ::google::protobuf::Closure* done) {
     (void) controller;
+    const int64_t submit_ns = common::TimeUtil::MonotonicNS();
+    bool ok = search_pool_.TrySubmit([=]() {
+      DocSearcher searcher;
+      searcher.Search(*req, resp, common::TimeUtil::MonotonicNS() - submit_ns);
+      done->Run();
+    });
+    if (!ok) {
+      // 队列已满, 不再排队
+      DocSearcher::Reject(*req, resp);
+      done->Run();
+    }
+  }
 
-    // resp->set_sid(req->sid()); //TODO
-    // resp->set_timestamp(common::TimeUtil::TimeStamp()); //TODO
-    // resp->set_err_code(0);
+  // 批量查询, 在线程池中并行处理, 最后一个处理完的线程调用 done->Run()
+  void SearchBatch(::google::protobuf::RpcController* controller, const BatchRequest* req,
+                   BatchResponse* resp, ::google::protobuf::Closure* done) {
+    (void) controller;
+    const int64_t submit_ns = common::TimeUtil::MonotonicNS();
+    common::WorkStealingPool* pool = &search_pool_;
+    bool ok = search_pool_.TrySubmit([=]() {
+      DocSearcher::SearchBatch(*req, resp, common::TimeUtil::MonotonicNS() - submit_ns,
+                               pool, [done]() { done->Run(); });
+    });
+    if (!ok) {
+      for (int i = 0; i < req->request_size(); ++i) {
+        DocSearcher::Reject(req->request(i), resp->add_response());
+      }
+      done->Run();
+    }
+  }
 
-    DocSearcher searcher;
-    searcher.Search(*req, resp);
+  // 交给 ReloadLoop 线程加载, 加载完之后在那个线程中调用 done->Run().
+  // 和 Search 一样, 排队的请求太多时直接返回过载的错误码
+  void Reload(::google::protobuf::RpcController* controller, const ReloadRequest* req,
+              ReloadResponse* resp, ::google::protobuf::Closure* done) {
+    (void) controller;
+    ReloadTask task;
+    task.index_path = req->index_path();
+    task.done = [resp, done](bool ok, uint64_t generation) {
+      resp->set_err_code(ok ? 0 : 1);
+      resp->set_generation(generation);
+      done->Run();
+    };
+    if (!ReloadQueue()->TryPush(task)) {
+      resp->set_err_code(kErrOverload);
+      resp->set_generation(doc_index::Index::Instance()->GetSnapshot()->generation());
+      done->Run();
+    }
+  }
 
+  void Stats(::google::protobuf::RpcController* controller, const StatsRequest* req,
+             StatsResponse* resp, ::google::protobuf::Closure* done) {
+    (void) controller;
+    (void) req;
+    DocSearcher::GetStats(resp);
     done->Run();
   }
+
+private:
+  common::WorkStealingPool search_pool_;
 };
 
 }  // end doc_server
@@ -40,12 +186,23 @@ int main(int argc, char* argv[]) {
   CHECK(index->Load(fLS::FLAGS_index_path));
   LOG(INFO) << "Index Load Done!";
   //std::cout << "Index Load Done!";
+  // 之后创建的线程都会继承这个信号屏蔽字, SIGHUP 只由 ReloadOnSignal 处理.
+  // 所有的线程都要在这之后创建, 否则 SIGHUP 可能被投递到没有屏蔽它的线程, 默认动作会结束进程
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGHUP);
+  CHECK(pthread_sigmask(SIG_BLOCK, &signals, NULL) == 0);
+  std::thread(doc_server::ReloadLoop).detach();
+  std::thread(doc_server::ReloadOnSignal, signals).detach();
+  // 查询日志由后台线程异步写入
+  CHECK(doc_server::QueryLog::Instance()->Start());
   
   // 1. 定义一个 RpcServerOptions 对象
   //    这个对象描述了 RPC 服务器一些相关选项
-  //    主要是为了定义线程池中线程的个数
+  //    主要是为了定义线程池中线程的个数. 查询在 DocServerAPIImpl 自己的
+  //    线程池中处理, 这里的线程只负责网络 IO
   RpcServerOptions option;
-  option.work_thread_num = 4;
+  option.work_thread_num = fLI::FLAGS_work_thread_num;
   // 2. 定义一个 RpcServer 对象(和ip端口号关联到一起)
   RpcServer server(option);
   CHECK(server.Start("0.0.0.0:" + fLS::FLAGS_port));
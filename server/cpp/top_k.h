@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace doc_server {
+
+// 一个文档在本次查询中的得分, 由所有命中的查询词的权重累加得到
+struct ScoredDoc {
+  uint32_t doc_id;
+  // 权重最大的那个查询词在正文中第一次出现的位置, 用于生成描述
+  int32_t first_pos;
+  int64_t score;
+};
+
+// 排序规则: 分数降序, 分数相同时 doc_id 小的在前.
+// 规则是全序的, 这样不同的检索方式得到的结果完全一致
+inline bool BetterDoc(const ScoredDoc& d1, const ScoredDoc& d2) {
+  if (d1.score != d2.score) {
+    return d1.score > d2.score;
+  }
+  return d1.doc_id < d2.doc_id;
+}
+
+// 只保留最好的 k 个结果. 内部是一个大小为 k 的堆, 堆顶是当前最差的结果,
+// 每次插入的代价是 O(log k), 和命中的文档总数无关
+class TopK {
+public:
+  explicit TopK(size_t k) : k_(k) {
+    heap_.reserve(k);
+  }
+
+  bool Full() const { return heap_.size() >= k_; }
+
+  // 堆满之后, 新的结果必须比堆顶更好才能进入. 按照 doc_id 升序处理文档时,
+  // 新的文档分数必须严格大于这个值才能进入结果. 堆未满时返回 INT64_MIN
+  int64_t Threshold() const {
+    if (!Full()) {
+      return INT64_MIN;
+    }
+    return k_ == 0 ? INT64_MAX : heap_.front().score;
+  }
+
+  bool Push(const ScoredDoc& doc) {
+    if (!Full()) {
+      heap_.push_back(doc);
+      std::push_heap(heap_.begin(), heap_.end(), BetterDoc);
+      return true;
+    }
+    if (k_ == 0 || !BetterDoc(doc, heap_.front())) {
+      return false;
+    }
+    std::pop_heap(heap_.begin(), heap_.end(), BetterDoc);
+    heap_.back() = doc;
+    std::push_heap(heap_.begin(), heap_.end(), BetterDoc);
+    return true;
+  }
+
+  // 按照从好到差的顺序取出所有结果
+  void Finish(std::vector<ScoredDoc>* docs) {
+    std::sort_heap(heap_.begin(), heap_.end(), BetterDoc);
+    docs->swap(heap_);
+    heap_.clear();
+  }
+
+private:
+  size_t k_;
+  std::vector<ScoredDoc> heap_;
+};
+
+}  // end doc_server